@@ -0,0 +1,97 @@
+/*
+ * bench_dryrun.c
+ * Cost and accuracy of the timing-only synthesis options against a full synthesis
+ *
+ * Each sentence is synthesized three ways with word marks: in full, with
+ * DECtalkOptionNoAudio, and with DECtalkOptionDryRun. The cache is disabled so
+ * every run reaches the engine.
+ *
+ * Two checks run alongside the timings. A NoAudio count must equal the full
+ * sample count exactly. A dry run's speech end must fall inside the full audio,
+ * and the gap up to the full length is reported as the engine's trailing
+ * silence. Exits with 1 if either check fails.
+ */
+
+#include "DECtalkBridge.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *g_sentences[] = {
+    "Hello.",
+    "The quick brown fox jumps over the lazy dog.",
+    "It was late, and the rain had not stopped; she waited by the window.",
+    "Call me at 555-1234 on the 3rd of May, or write to 42 Main Street.",
+    "Is this the right platform for the train to the coast?",
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Synthesize text iterations times with options, keeping the last result
+static double measure(const char *text, uint32_t options, int iterations, dectalk_audio_t **audio) {
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        dectalk_audio_free(*audio);
+        *audio = NULL;
+        if (dectalk_synthesize_audio_ex(text, options, audio) != DECtalkErrorNone) {
+            return -1.0;
+        }
+    }
+    return (now_seconds() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 10;
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    if (dectalk_init() != DECtalkErrorNone) {
+        fprintf(stderr, "dectalk_init failed\n");
+        return 1;
+    }
+    dectalk_cache_set_budget(0);
+
+    bool failed = false;
+    printf("%-8s %9s %9s %9s %9s %9s %9s %9s\n", "sentence", "samples", "no audio", "speech",
+           "tail ms", "full ms", "none ms", "dry ms");
+    for (size_t s = 0; s < sizeof(g_sentences) / sizeof(g_sentences[0]); s++) {
+        dectalk_audio_t *full = NULL, *noAudio = NULL, *dryRun = NULL;
+        double fullSeconds = measure(g_sentences[s], DECtalkOptionWordMarks, iterations, &full);
+        double noAudioSeconds = measure(g_sentences[s], DECtalkOptionWordMarks | DECtalkOptionNoAudio,
+                                        iterations, &noAudio);
+        double dryRunSeconds = measure(g_sentences[s], DECtalkOptionWordMarks | DECtalkOptionDryRun,
+                                       iterations, &dryRun);
+        if (fullSeconds < 0.0 || noAudioSeconds < 0.0 || dryRunSeconds < 0.0) {
+            fprintf(stderr, "synthesis failed for sentence %zu\n", s + 1);
+            return 1;
+        }
+
+        int32_t samples = dectalk_audio_get_sample_count(full);
+        int32_t counted = dectalk_audio_get_sample_count(noAudio);
+        int32_t speechEnd = dectalk_audio_get_speech_end(dryRun);
+        printf("%-8zu %9d %9d %9d %9.1f %9.2f %9.2f %9.2f\n", s + 1, samples, counted, speechEnd,
+               (samples - speechEnd) * 1000.0 / dectalk_get_sample_rate(),
+               fullSeconds * 1e3, noAudioSeconds * 1e3, dryRunSeconds * 1e3);
+
+        if (counted != samples) {
+            printf("  FAIL: NoAudio counted %d samples, full synthesis has %d\n", counted, samples);
+            failed = true;
+        }
+        if (speechEnd <= 0 || speechEnd > samples) {
+            printf("  FAIL: dry run speech end %d is outside the %d samples of audio\n", speechEnd, samples);
+            failed = true;
+        }
+
+        dectalk_audio_free(full);
+        dectalk_audio_free(noAudio);
+        dectalk_audio_free(dryRun);
+    }
+
+    dectalk_shutdown();
+    return failed ? 1 : 0;
+}
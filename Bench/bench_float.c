@@ -0,0 +1,162 @@
+/*
+ * bench_float.c
+ * Cycles per sample of the fused float output pipeline
+ *
+ * Each configuration runs a minute of engine audio through
+ * dectalk_float_pipeline_process in engine-buffer-sized chunks, and through the
+ * same steps done as separate passes over the buffer the way consumers did
+ * before: resample the 16-bit samples, convert to float, apply the gain, then
+ * remove DC. Costs are per engine sample.
+ *
+ * On x86 cycles come from the time stamp counter. Elsewhere there is no cycle
+ * counter user code can read, so time is converted at the clock rate given as
+ * the second argument (GHz, default 3.2).
+ */
+
+#include "DECtalkBridge.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define ENGINE_RATE 11025
+#define INPUT_SAMPLES (ENGINE_RATE * 60)
+#define CHUNK 1024
+
+typedef struct {
+    const char *name;
+    int outputRate;
+    float gain;
+    bool dcBlock;
+} Configuration;
+
+static double g_ghz = 3.2;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Returns cycles and seconds spent in run
+static void measure(void (*run)(const Configuration*, const int16_t*, float*), const Configuration *config,
+                    const int16_t *input, float *output, int iterations, double *cycles, double *seconds) {
+    run(config, input, output);
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t startCycles = __rdtsc();
+#endif
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        run(config, input, output);
+    }
+    *seconds = (now_seconds() - start) / iterations;
+#if defined(__x86_64__) || defined(__i386__)
+    *cycles = (double)(__rdtsc() - startCycles) / iterations;
+#else
+    *cycles = *seconds * g_ghz * 1e9;
+#endif
+}
+
+static void run_fused(const Configuration *config, const int16_t *input, float *output) {
+    dectalk_float_pipeline_t *pipeline = dectalk_float_pipeline_create(ENGINE_RATE, config->outputRate,
+                                                                       config->gain, config->dcBlock);
+    float *out = output;
+    for (int32_t i = 0; i < INPUT_SAMPLES; i += CHUNK) {
+        int32_t count = INPUT_SAMPLES - i < CHUNK ? INPUT_SAMPLES - i : CHUNK;
+        out += dectalk_float_pipeline_process(pipeline, input + i, count, out);
+    }
+    dectalk_float_pipeline_flush(pipeline, out);
+    dectalk_float_pipeline_destroy(pipeline);
+}
+
+// The same work as one pass per step over each chunk
+static void run_separate(const Configuration *config, const int16_t *input, float *output) {
+    dectalk_resampler_t *resampler = config->outputRate != ENGINE_RATE
+        ? dectalk_resampler_create(ENGINE_RATE, config->outputRate) : NULL;
+    int16_t *resampled = (int16_t*)malloc((size_t)(resampler ? dectalk_resampler_max_output(resampler, CHUNK)
+                                                             : CHUNK) * sizeof(int16_t));
+    // 10 Hz one-pole high-pass, as the pipeline's DC blocker
+    float pole = 1.0f - (float)(2.0 * M_PI * 10.0 / config->outputRate);
+    float lastIn = 0.0f, lastOut = 0.0f;
+
+    float *out = output;
+    for (int32_t i = 0; i < INPUT_SAMPLES; i += CHUNK) {
+        int32_t count = INPUT_SAMPLES - i < CHUNK ? INPUT_SAMPLES - i : CHUNK;
+        const int16_t *samples = input + i;
+        if (resampler) {
+            count = dectalk_resampler_process(resampler, samples, count, resampled);
+            samples = resampled;
+        }
+
+        dectalk_convert_to_float(samples, out, count);
+        if (config->gain != 1.0f) {
+            for (int32_t j = 0; j < count; j++) {
+                out[j] *= config->gain;
+            }
+        }
+        if (config->dcBlock) {
+            for (int32_t j = 0; j < count; j++) {
+                float x = out[j];
+                lastOut = x - lastIn + pole * lastOut;
+                lastIn = x;
+                out[j] = lastOut;
+            }
+        }
+        out += count;
+    }
+
+    dectalk_resampler_destroy(resampler);
+    free(resampled);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 10;
+    if (iterations < 1) {
+        iterations = 1;
+    }
+    if (argc > 2 && atof(argv[2]) > 0.0) {
+        g_ghz = atof(argv[2]);
+    }
+
+    const Configuration configurations[] = {
+        { "convert", ENGINE_RATE, 1.0f, false },
+        { "gain", ENGINE_RATE, 0.5f, false },
+        { "gain + dc", ENGINE_RATE, 0.5f, true },
+        { "gain + 22050", 22050, 0.5f, false },
+        { "gain + dc + 48000", 48000, 0.5f, true },
+    };
+
+    int16_t *input = (int16_t*)malloc(INPUT_SAMPLES * sizeof(int16_t));
+    float *output = (float*)malloc((size_t)INPUT_SAMPLES * 5 * sizeof(float));
+    srand(1);
+    for (int32_t i = 0; i < INPUT_SAMPLES; i++) {
+        double t = (double)i / ENGINE_RATE;
+        input[i] = (int16_t)(200.0 + 8000.0 * sin(2.0 * M_PI * 140.0 * t) +
+                             2000.0 * sin(2.0 * M_PI * 1800.0 * t) + (rand() % 600 - 300));
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("Cycles from the time stamp counter\n");
+#else
+    printf("Cycles estimated at %.2f GHz\n", g_ghz);
+#endif
+    printf("%-20s %18s %18s %8s\n", "per engine sample", "fused cycles (ns)", "passes cycles (ns)", "speedup");
+    for (size_t c = 0; c < sizeof(configurations) / sizeof(configurations[0]); c++) {
+        double fusedCycles, fusedSeconds, separateCycles, separateSeconds;
+        measure(run_fused, &configurations[c], input, output, iterations, &fusedCycles, &fusedSeconds);
+        measure(run_separate, &configurations[c], input, output, iterations, &separateCycles, &separateSeconds);
+
+        printf("%-20s %9.2f (%6.2f) %9.2f (%6.2f) %7.2fx\n", configurations[c].name,
+               fusedCycles / INPUT_SAMPLES, fusedSeconds * 1e9 / INPUT_SAMPLES,
+               separateCycles / INPUT_SAMPLES, separateSeconds * 1e9 / INPUT_SAMPLES,
+               separateSeconds / fusedSeconds);
+    }
+
+    free(input);
+    free(output);
+    return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * bench_ssml.c
+ * Benchmark of dectalk_ssml_compile against the regex chain it replaced
+ *
+ * The old Swift parseSSML ran NSRegularExpression passes for the prosody
+ * attributes, <break>, <emphasis> and <say-as>, then
+ * dectalk_extract_text_from_ssml, then a last regex pass restoring stripped
+ * '[' in inline commands, copying the whole string at every step. The chain is
+ * rebuilt here with POSIX regular expressions, pass for pass, so both sides
+ * run in C. NSRegularExpression on Swift strings is slower than regexec, so
+ * this understates the gap.
+ */
+
+#include "DECtalkBridge.h"
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// A typical request: a paragraph with every element the chain handles
+static const char *g_paragraph =
+    "<prosody rate=\"fast\" pitch=\"high\" volume=\"loud\">"
+    "Welcome back. Your next appointment is on <say-as interpret-as=\"date\">2024-03-15</say-as>"
+    "<break time=\"300ms\"/> with Dr. Smith &amp; associates. "
+    "<emphasis level=\"strong\">Please arrive early</emphasis>, and call "
+    "<say-as interpret-as=\"telephone\">555-867-5309</say-as> to reschedule. "
+    "Your code is <say-as interpret-as=\"characters\">AB12</say-as>."
+    "<break strength=\"medium\"/> :np] Thank you for choosing us. "
+    "<emphasis level=\"reduced\">This message repeats once.</emphasis>"
+    "</prosody> ";
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// MARK: - Regex chain
+
+typedef struct {
+    regex_t rate, pitch, volume;
+    regex_t brk, time, strength;
+    regex_t emphasis, sayAs, command;
+} RegexChain;
+
+// Rebuilds the string with each match replaced, like the Swift passes did
+typedef void (*Replacer)(const char *match, const regmatch_t *groups, char *out, size_t outSize);
+
+static char *replace_all(const regex_t *regex, const char *in, Replacer replacer) {
+    size_t capacity = strlen(in) * 2 + 256;
+    char *out = (char*)malloc(capacity);
+    size_t length = 0;
+    regmatch_t groups[8];
+    const char *p = in;
+
+    while (regexec(regex, p, 8, groups, p == in ? 0 : REG_NOTBOL) == 0) {
+        char replacement[1024];
+        replacer(p, groups, replacement, sizeof(replacement));
+        size_t prefix = (size_t)groups[0].rm_so;
+        size_t added = strlen(replacement);
+        if (length + prefix + added + 1 > capacity) {
+            capacity = (length + prefix + added + 1) * 2;
+            out = (char*)realloc(out, capacity);
+        }
+        memcpy(out + length, p, prefix);
+        memcpy(out + length + prefix, replacement, added);
+        length += prefix + added;
+        p += groups[0].rm_eo;
+    }
+
+    size_t rest = strlen(p);
+    if (length + rest + 1 > capacity) {
+        out = (char*)realloc(out, length + rest + 1);
+    }
+    memcpy(out + length, p, rest + 1);
+    return out;
+}
+
+static void group_copy(const char *base, const regmatch_t *group, char *out, size_t outSize) {
+    size_t n = group->rm_so < 0 ? 0 : (size_t)(group->rm_eo - group->rm_so);
+    if (n >= outSize) {
+        n = outSize - 1;
+    }
+    memcpy(out, base + (group->rm_so < 0 ? 0 : group->rm_so), n);
+    out[n] = '\0';
+}
+
+static RegexChain g_chain;
+
+static void break_replacer(const char *match, const regmatch_t *groups, char *out, size_t outSize) {
+    char attributes[256], value[64];
+    group_copy(match, &groups[1], attributes, sizeof(attributes));
+
+    int pauseMs = 250;
+    regmatch_t attr[2];
+    if (regexec(&g_chain.time, attributes, 2, attr, 0) == 0) {
+        group_copy(attributes, &attr[1], value, sizeof(value));
+        size_t n = strlen(value);
+        pauseMs = n > 2 && strcasecmp(value + n - 2, "ms") == 0 ? atoi(value) : (int)(atof(value) * 1000);
+    } else if (regexec(&g_chain.strength, attributes, 2, attr, 0) == 0) {
+        group_copy(attributes, &attr[1], value, sizeof(value));
+        static const char *names[] = { "none", "x-weak", "weak", "medium", "strong", "x-strong" };
+        static const int pauses[] = { 0, 100, 150, 300, 500, 1000 };
+        for (int i = 0; i < 6; i++) {
+            if (strcasecmp(value, names[i]) == 0) {
+                pauseMs = pauses[i];
+            }
+        }
+    }
+    if (pauseMs > 0) {
+        snprintf(out, outSize, " [:pause %d] ", pauseMs);
+    } else {
+        out[0] = '\0';
+    }
+}
+
+static void emphasis_replacer(const char *match, const regmatch_t *groups, char *out, size_t outSize) {
+    char level[32], content[512];
+    group_copy(match, &groups[2], level, sizeof(level));
+    group_copy(match, &groups[3], content, sizeof(content));
+
+    if (strcasecmp(level, "reduced") == 0) {
+        snprintf(out, outSize, "[:rate -20][:dv ap -2]%s[:rate +20][:dv ap +2]", content);
+    } else if (strcasecmp(level, "strong") == 0) {
+        snprintf(out, outSize, "[:rate -30][:dv ap +5]%s[:rate +30][:dv ap -5]", content);
+    } else if (strcasecmp(level, "none") == 0) {
+        snprintf(out, outSize, "%s", content);
+    } else {
+        snprintf(out, outSize, "[:dv ap +3]%s[:dv ap -3]", content);
+    }
+}
+
+static void say_as_replacer(const char *match, const regmatch_t *groups, char *out, size_t outSize) {
+    char type[32], content[256];
+    group_copy(match, &groups[1], type, sizeof(type));
+    group_copy(match, &groups[4], content, sizeof(content));
+
+    size_t length = 0;
+    out[0] = '\0';
+    if (strcasecmp(type, "characters") == 0 || strcasecmp(type, "spell-out") == 0) {
+        for (const char *c = content; *c && length + 32 < outSize; c++) {
+            length += (size_t)snprintf(out + length, outSize - length,
+                                       *c == ' ' ? "[:pause 200] space [:pause 200]" : "%c [:pause 100]", *c);
+        }
+    } else if (strcasecmp(type, "telephone") == 0) {
+        int digit = 0;
+        for (const char *c = content; *c && length + 32 < outSize; c++) {
+            if (*c >= '0' && *c <= '9') {
+                length += (size_t)snprintf(out + length, outSize - length, "%c [:pause %d]",
+                                           *c, digit == 2 || digit == 5 ? 200 : 80);
+                digit++;
+            }
+        }
+    } else {
+        snprintf(out, outSize, "%s", content);
+    }
+}
+
+static void command_replacer(const char *match, const regmatch_t *groups, char *out, size_t outSize) {
+    char lead[8], command[256];
+    group_copy(match, &groups[1], lead, sizeof(lead));
+    group_copy(match, &groups[2], command, sizeof(command));
+    snprintf(out, outSize, "%s[%s", lead, command);
+}
+
+static void chain_init(RegexChain *chain) {
+    int flags = REG_EXTENDED | REG_ICASE;
+    regcomp(&chain->rate, "rate=\"([^\"]+)\"", flags);
+    regcomp(&chain->pitch, "pitch=\"([^\"]+)\"", flags);
+    regcomp(&chain->volume, "volume=\"([^\"]+)\"", flags);
+    regcomp(&chain->brk, "<break[[:space:]]+([^>]*[^/>])?[[:space:]]*/?>(</break>)?", flags);
+    regcomp(&chain->time, "time=\"([^\"]+)\"", flags);
+    regcomp(&chain->strength, "strength=\"([^\"]+)\"", flags);
+    // POSIX has no lazy quantifier; element content without markup is the common case
+    regcomp(&chain->emphasis, "<emphasis([[:space:]]+level=\"([^\"]*)\")?[[:space:]]*>([^<]*)</emphasis>", flags);
+    regcomp(&chain->sayAs, "<say-as[[:space:]]+interpret-as=\"([^\"]+)\"([[:space:]]+format=\"([^\"]+)\")?"
+            "[[:space:]]*>([^<]*)</say-as>", flags);
+    regcomp(&chain->command, "(^|[[:space:]])(:(rate|volume|pitch|np|nb|nh|nf|nd|nk|nu|nr|nw|dv|phoneme|punct|"
+            "tone|comma|period|log|error|index|sync|play|dial|mode|say|skip|email|latin|name|note|pronounce|"
+            "pp|cp|design|gender|breath|head|smooth|richness|lx|hs|f4|b4|f5|b5|lo|speed|pause)[^]]*\\])", flags);
+}
+
+// One request through the chain; returns the length of the text handed to the engine
+static size_t chain_run(const RegexChain *chain, const char *ssml) {
+    char commands[128] = "";
+    regmatch_t groups[2];
+    char value[64];
+
+    // Only the first prosody element counted, as in parseSSML
+    if (regexec(&chain->rate, ssml, 2, groups, 0) == 0) {
+        group_copy(ssml, &groups[1], value, sizeof(value));
+        double rate = strcasecmp(value, "fast") == 0 ? 1.5 : strcasecmp(value, "slow") == 0 ? 0.75 : 1.0;
+        int wpm = (int)(180.0 * rate);
+        snprintf(commands + strlen(commands), sizeof(commands) - strlen(commands), "[:rate %d]",
+                 wpm < 75 ? 75 : wpm > 650 ? 650 : wpm);
+    }
+    if (regexec(&chain->pitch, ssml, 2, groups, 0) == 0) {
+        group_copy(ssml, &groups[1], value, sizeof(value));
+        double pitch = strcasecmp(value, "high") == 0 ? 1.25 : strcasecmp(value, "low") == 0 ? 0.8 : 1.0;
+        snprintf(commands + strlen(commands), sizeof(commands) - strlen(commands), "[:dv ap %d]",
+                 (int)(122 * pitch));
+    }
+    if (regexec(&chain->volume, ssml, 2, groups, 0) == 0) {
+        snprintf(commands + strlen(commands), sizeof(commands) - strlen(commands), "[:volume set %d]", 100);
+    }
+
+    char *afterBreak = replace_all(&chain->brk, ssml, break_replacer);
+    char *afterEmphasis = replace_all(&chain->emphasis, afterBreak, emphasis_replacer);
+    char *afterSayAs = replace_all(&chain->sayAs, afterEmphasis, say_as_replacer);
+
+    int32_t plainSize = (int32_t)strlen(afterSayAs) * 2 + 1;
+    char *plain = (char*)malloc((size_t)plainSize);
+    dectalk_extract_text_from_ssml(afterSayAs, plain, plainSize);
+    char *text = replace_all(&chain->command, plain, command_replacer);
+
+    // The commands are prepended to the text before speaking
+    size_t length = strlen(commands) + strlen(text);
+    char *full = (char*)malloc(length + 1);
+    strcpy(full, commands);
+    strcat(full, text);
+
+    free(afterBreak);
+    free(afterEmphasis);
+    free(afterSayAs);
+    free(plain);
+    free(text);
+    free(full);
+    return length;
+}
+
+// MARK: - Benchmark
+
+static void run(const char *label, const char *ssml, int iterations) {
+    size_t inputLength = strlen(ssml);
+    int32_t outSize = (int32_t)inputLength * 4 + 1024;
+    char *out = (char*)malloc((size_t)outSize);
+
+    // Warm up both paths and check that they produce comparable output
+    size_t chainLength = chain_run(&g_chain, ssml);
+    int32_t compiledLength = dectalk_ssml_compile(ssml, DECtalkVoicePaul, 180, -1, out, outSize);
+
+    volatile size_t sink = 0;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        sink += chain_run(&g_chain, ssml);
+    }
+    double chainTime = (now_seconds() - start) / iterations;
+
+    start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        sink += (size_t)dectalk_ssml_compile(ssml, DECtalkVoicePaul, 180, -1, out, outSize);
+    }
+    double compileTime = (now_seconds() - start) / iterations;
+    (void)sink;
+
+    printf("%s: %zu bytes in, chain %zu / compiler %d bytes out\n",
+           label, inputLength, chainLength, compiledLength);
+    printf("  regex chain  %10.2f us/request  %8.1f MB/s\n",
+           chainTime * 1e6, inputLength / chainTime / 1e6);
+    printf("  ssml_compile %10.2f us/request  %8.1f MB/s  (%.1fx)\n",
+           compileTime * 1e6, inputLength / compileTime / 1e6, chainTime / compileTime);
+    free(out);
+}
+
+int main(int argc, char **argv) {
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    if (scale < 1) {
+        scale = 1;
+    }
+    chain_init(&g_chain);
+
+    // A single paragraph, and a chapter-sized document of many
+    size_t paragraphLength = strlen(g_paragraph);
+    size_t count = 200;
+    char *chapter = (char*)malloc(paragraphLength * count + 32);
+    strcpy(chapter, "<speak>");
+    for (size_t i = 0; i < count; i++) {
+        strcat(chapter, g_paragraph);
+    }
+    strcat(chapter, "</speak>");
+
+    run("paragraph", g_paragraph, 20000 * scale);
+    run("chapter", chapter, 20 * scale);
+
+    free(chapter);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * bench_upsample.c
+ * Quality and speed of dectalk_upsample_2x against the Swift resamplers it replaced
+ *
+ * resampleAudioFast (linear midpoints) and resampleAudio (Catmull-Rom midpoints
+ * followed by a 3-tap smoother) are ported line for line from the audio unit,
+ * minus Swift's array bounds checks, so the speed comparison flatters them.
+ *
+ * Quality is measured on sine tones at 11025 Hz. Upsampling to 22050 Hz leaves
+ * an image of a tone at f mirrored to 11025 - f; a good filter removes it and
+ * keeps the tone itself at its level. Both are measured with the Goertzel
+ * algorithm, so the filter's delay does not matter.
+ */
+
+#include "DECtalkBridge.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INPUT_RATE 11025
+#define OUTPUT_RATE 22050
+
+// One second of input for quality, a minute for speed
+#define QUALITY_SAMPLES INPUT_RATE
+#define SPEED_SAMPLES (INPUT_RATE * 60)
+
+typedef void (*Upsampler)(const int16_t *samples, int32_t count, float *out);
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// MARK: - Swift resamplers
+
+static void resample_fast(const int16_t *samples, int32_t count, float *out) {
+    const float scale = 1.0f / 32768.0f;
+    for (int32_t i = 0; i < count; i++) {
+        float s1 = (float)samples[i] * scale;
+        out[i * 2] = s1;
+        out[i * 2 + 1] = i + 1 < count ? (s1 + (float)samples[i + 1] * scale) * 0.5f : s1;
+    }
+}
+
+static void resample_catmull_rom(const int16_t *samples, int32_t count, float *out) {
+    // The Swift version converted and scaled into a separate array first
+    float *normalized = (float*)malloc((size_t)count * sizeof(float));
+    for (int32_t i = 0; i < count; i++) {
+        normalized[i] = (float)samples[i] * (1.0f / 32768.0f);
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        float s0 = i > 0 ? normalized[i - 1] : normalized[0];
+        float s1 = normalized[i];
+        float s2 = i + 1 < count ? normalized[i + 1] : normalized[count - 1];
+        float s3 = i + 2 < count ? normalized[i + 2] : normalized[count - 1];
+
+        const float t = 0.5f, t2 = t * t, t3 = t2 * t;
+        float a0 = -s0 + 3.0f * s1 - 3.0f * s2 + s3;
+        float a1 = 2.0f * s0 - 5.0f * s1 + 4.0f * s2 - s3;
+        float a2 = -s0 + s2;
+        float a3 = 2.0f * s1;
+
+        out[i * 2] = s1;
+        out[i * 2 + 1] = 0.5f * (a3 + a2 * t + a1 * t2 + a0 * t3);
+    }
+
+    // Gentle low-pass over the interpolated samples only
+    for (int32_t i = 1; i < count * 2 - 1; i += 2) {
+        out[i] = 0.25f * out[i - 1] + 0.5f * out[i] + 0.25f * out[i + 1];
+    }
+    free(normalized);
+}
+
+static void resample_bridge(const int16_t *samples, int32_t count, float *out) {
+    dectalk_upsample_2x(samples, count, out);
+}
+
+// MARK: - Measurements
+
+// Power of frequency in samples, normalized so a full-scale sine gives 1.0
+static double goertzel_power(const float *samples, int32_t count, double frequency, int rate) {
+    double coefficient = 2.0 * cos(2.0 * M_PI * frequency / rate);
+    double s1 = 0.0, s2 = 0.0;
+    for (int32_t i = 0; i < count; i++) {
+        double s0 = samples[i] + coefficient * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return (s1 * s1 + s2 * s2 - coefficient * s1 * s2) / ((double)count * count / 4.0);
+}
+
+static void measure_tone(Upsampler upsampler, double frequency, double *gainDb, double *imageDb) {
+    int16_t *input = (int16_t*)malloc(QUALITY_SAMPLES * sizeof(int16_t));
+    float *output = (float*)malloc(QUALITY_SAMPLES * 2 * sizeof(float));
+    for (int32_t i = 0; i < QUALITY_SAMPLES; i++) {
+        input[i] = (int16_t)lrint(16384.0 * sin(2.0 * M_PI * frequency * i / INPUT_RATE));
+    }
+    upsampler(input, QUALITY_SAMPLES, output);
+
+    // Skip the edges where the filters see padding
+    int32_t skip = 256;
+    int32_t count = QUALITY_SAMPLES * 2 - 2 * skip;
+    double tone = goertzel_power(output + skip, count, frequency, OUTPUT_RATE);
+    double image = goertzel_power(output + skip, count, INPUT_RATE - frequency, OUTPUT_RATE);
+    double reference = 0.5 * 0.5;   // Amplitude 16384 / 32768, squared
+
+    *gainDb = 10.0 * log10(tone / reference);
+    *imageDb = 10.0 * log10(image / tone + 1e-30);
+    free(input);
+    free(output);
+}
+
+static double measure_speed(Upsampler upsampler, const int16_t *input, float *output, int iterations) {
+    upsampler(input, SPEED_SAMPLES, output);
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        upsampler(input, SPEED_SAMPLES, output);
+    }
+    return (now_seconds() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    const struct {
+        const char *name;
+        Upsampler upsampler;
+    } methods[] = {
+        { "resampleAudioFast", resample_fast },
+        { "resampleAudio", resample_catmull_rom },
+        { "dectalk_upsample_2x", resample_bridge },
+    };
+    const int methodCount = (int)(sizeof(methods) / sizeof(methods[0]));
+    const double tones[] = { 250.0, 1000.0, 2500.0, 4000.0, 5000.0 };
+    const int toneCount = (int)(sizeof(tones) / sizeof(tones[0]));
+
+    printf("Quality: tone level change / image level relative to the tone (dB)\n");
+    printf("%-20s", "tone (Hz)");
+    for (int t = 0; t < toneCount; t++) {
+        printf(" %16.0f", tones[t]);
+    }
+    printf("\n");
+    for (int m = 0; m < methodCount; m++) {
+        printf("%-20s", methods[m].name);
+        for (int t = 0; t < toneCount; t++) {
+            double gainDb, imageDb;
+            measure_tone(methods[m].upsampler, tones[t], &gainDb, &imageDb);
+            printf("    %5.2f / %6.1f", gainDb, imageDb);
+        }
+        printf("\n");
+    }
+
+    // Speech-like input: a few harmonics with some noise
+    int16_t *input = (int16_t*)malloc(SPEED_SAMPLES * sizeof(int16_t));
+    float *output = (float*)malloc(SPEED_SAMPLES * 2 * sizeof(float));
+    srand(1);
+    for (int32_t i = 0; i < SPEED_SAMPLES; i++) {
+        double t = (double)i / INPUT_RATE;
+        double value = 6000.0 * sin(2.0 * M_PI * 120.0 * t) + 3000.0 * sin(2.0 * M_PI * 720.0 * t) +
+                       1500.0 * sin(2.0 * M_PI * 2400.0 * t) + (rand() % 1000 - 500);
+        input[i] = (int16_t)value;
+    }
+
+    printf("\nSpeed: %d s of input, relative to resampleAudioFast\n", SPEED_SAMPLES / INPUT_RATE);
+    double baseline = 0.0;
+    for (int m = 0; m < methodCount; m++) {
+        double seconds = measure_speed(methods[m].upsampler, input, output, iterations);
+        if (m == 0) {
+            baseline = seconds;
+        }
+        printf("%-20s %8.3f ms  %7.2f ns/input sample  %6.2fx\n", methods[m].name,
+               seconds * 1e3, seconds * 1e9 / SPEED_SAMPLES, baseline / seconds);
+    }
+
+    free(input);
+    free(output);
+    return 0;
+}
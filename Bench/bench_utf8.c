@@ -0,0 +1,126 @@
+/*
+ * bench_utf8.c
+ * Throughput of dectalk_text_to_engine_charset
+ *
+ * Each corpus is transcoded repeatedly and reported in MB/s of UTF-8 input.
+ * Two references frame the numbers: memcpy, which is what passing the raw bytes
+ * straight to the engine cost, and a plain byte-at-a-time decoder that only
+ * computes code points, the least a correct transcoder has to do.
+ */
+
+#include "DECtalkBridge.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Corpus size after repeating each sample
+#define CORPUS_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+    const char *name;
+    const char *sample;
+} Corpus;
+
+static const Corpus g_corpora[] = {
+    { "ascii prose",
+      "The quick brown fox jumps over the lazy dog, then naps until the afternoon. "
+      "Meanwhile the reader turns the page and keeps going through chapter twelve. " },
+    { "typographic",
+      "\xE2\x80\x9CIt\xE2\x80\x99s late,\xE2\x80\x9D she said \xE2\x80\x94 the clock read 11\xE2\x80\x93" "12\xE2\x80\xA6 "
+      "\xE2\x80\x98" "Fine\xE2\x80\x99, he replied. Price: 20\xE2\x82\xAC\xE2\x84\xA2. " },
+    { "latin-1 french",
+      "L'\xC3\xA9t\xC3\xA9 dernier, \xC3\xA0 l'h\xC3\xB4tel, nous avons d\xC3\xAEn\xC3\xA9 pr\xC3\xA8s de la "
+      "fen\xC3\xAAtre; le gar\xC3\xA7on \xC3\xA9tait tr\xC3\xA8s aimable. " },
+    { "emoji and cjk",
+      "Great job \xF0\x9F\x98\x80\xF0\x9F\x91\x8D! \xE6\x9D\xB1\xE4\xBA\xAC is lovely \xE2\x9D\xA4\xEF\xB8\x8F "
+      "see you soon \xF0\x9F\x9A\x80 " },
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Reference decoder: one branchy step per code point, no mapping
+static uint32_t decode_reference(const unsigned char *p, size_t length) {
+    const unsigned char *end = p + length;
+    uint32_t checksum = 0;
+    while (p < end) {
+        uint32_t c = *p;
+        if (c < 0x80) {
+            p++;
+        } else if ((c & 0xE0) == 0xC0 && p + 1 < end) {
+            c = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+            p += 2;
+        } else if ((c & 0xF0) == 0xE0 && p + 2 < end) {
+            c = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+            p += 3;
+        } else if ((c & 0xF8) == 0xF0 && p + 3 < end) {
+            c = ((c & 0x07) << 18) | ((p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+            p += 4;
+        } else {
+            p++;
+        }
+        checksum += c;
+    }
+    return checksum;
+}
+
+static char *build_corpus(const char *sample, size_t *length) {
+    size_t sampleLength = strlen(sample);
+    size_t count = CORPUS_BYTES / sampleLength;
+    char *corpus = (char*)malloc(count * sampleLength + 1);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(corpus + i * sampleLength, sample, sampleLength);
+    }
+    corpus[count * sampleLength] = '\0';
+    *length = count * sampleLength;
+    return corpus;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    printf("%-16s %12s %12s %12s %10s\n", "corpus", "memcpy MB/s", "decode MB/s", "engine MB/s", "out/in");
+    for (size_t c = 0; c < sizeof(g_corpora) / sizeof(g_corpora[0]); c++) {
+        size_t length;
+        char *corpus = build_corpus(g_corpora[c].sample, &length);
+        // Spelled-out symbols can make the output longer than the input
+        int32_t outSize = (int32_t)length * 4 + 1;
+        char *out = (char*)malloc((size_t)outSize);
+
+        int32_t written = dectalk_text_to_engine_charset(corpus, out, outSize);
+
+        double start = now_seconds();
+        for (int i = 0; i < iterations; i++) {
+            memcpy(out, corpus, length);
+        }
+        double copyTime = (now_seconds() - start) / iterations;
+
+        volatile uint32_t sink = 0;
+        start = now_seconds();
+        for (int i = 0; i < iterations; i++) {
+            sink += decode_reference((const unsigned char*)corpus, length);
+        }
+        double decodeTime = (now_seconds() - start) / iterations;
+        (void)sink;
+
+        start = now_seconds();
+        for (int i = 0; i < iterations; i++) {
+            written = dectalk_text_to_engine_charset(corpus, out, outSize);
+        }
+        double engineTime = (now_seconds() - start) / iterations;
+
+        printf("%-16s %12.0f %12.0f %12.0f %10.2f\n", g_corpora[c].name,
+               length / copyTime / 1e6, length / decodeTime / 1e6, length / engineTime / 1e6,
+               (double)written / (double)length);
+        free(out);
+        free(corpus);
+    }
+    return 0;
+}
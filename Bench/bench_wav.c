@@ -0,0 +1,126 @@
+/*
+ * bench_wav.c
+ * Throughput and memory of streaming synthesis to a WAV file against the in-memory path
+ *
+ * A chapter of text is rendered three ways: streamed to disk with
+ * dectalk_synthesize_to_file, held in memory with dectalk_synthesize_audio, and
+ * held in memory and then written out, which is what rendering a chapter to disk
+ * took before. The cache is disabled so every run synthesizes, and audio stays
+ * at the default output rate.
+ *
+ * Peak memory only grows, so the streaming run goes first and the growth of the
+ * peak is reported after each run.
+ */
+
+#include "DECtalkBridge.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static const char *g_paragraph =
+    "It was late in the evening when the train finally pulled into the station. "
+    "The platform was empty except for an old man reading a newspaper under a lamp, "
+    "and the rain had turned the tracks into long silver lines that ran into the dark. "
+    "She picked up her suitcase, stepped down, and wondered whether anyone would come. ";
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Peak resident memory in bytes
+static double peak_bytes(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (double)usage.ru_maxrss;
+#else
+    return (double)usage.ru_maxrss * 1024.0;
+#endif
+}
+
+static void report(const char *name, double seconds, int64_t samples, double peakGrowth) {
+    double audioSeconds = (double)samples / DECTALK_SAMPLE_RATE;
+    printf("%-22s %8.2f s  %7.1fx real time  %7.2f MB/s  peak +%7.1f MB\n", name, seconds,
+           audioSeconds / seconds, samples * sizeof(int16_t) / seconds / 1e6, peakGrowth / 1e6);
+}
+
+int main(int argc, char **argv) {
+    int paragraphs = argc > 1 ? atoi(argv[1]) : 100;
+    const char *path = argc > 2 ? argv[2] : "/tmp/bench_wav.wav";
+    if (paragraphs < 1) {
+        paragraphs = 1;
+    }
+
+    size_t paragraphLength = strlen(g_paragraph);
+    char *chapter = (char*)malloc(paragraphLength * (size_t)paragraphs + 1);
+    for (int i = 0; i < paragraphs; i++) {
+        memcpy(chapter + paragraphLength * (size_t)i, g_paragraph, paragraphLength);
+    }
+    chapter[paragraphLength * (size_t)paragraphs] = '\0';
+
+    if (dectalk_init() != DECtalkErrorNone) {
+        fprintf(stderr, "dectalk_init failed\n");
+        return 1;
+    }
+    dectalk_cache_set_budget(0);
+
+    // Start the engine before timing anything
+    dectalk_audio_t *audio = NULL;
+    dectalk_synthesize_audio("Ready.", &audio);
+    dectalk_audio_free(audio);
+    audio = NULL;
+
+    printf("%d paragraphs, %zu bytes of text\n", paragraphs, strlen(chapter));
+
+    double peak = peak_bytes();
+    double start = now_seconds();
+    int result = dectalk_synthesize_to_file(chapter, path);
+    double fileSeconds = now_seconds() - start;
+    if (result != DECtalkErrorNone) {
+        fprintf(stderr, "dectalk_synthesize_to_file failed: %d\n", result);
+        return 1;
+    }
+    FILE *file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    int64_t fileSamples = (ftell(file) - 80) / (int64_t)sizeof(int16_t);   // 80-byte header
+    fclose(file);
+    report("stream to file", fileSeconds, fileSamples, peak_bytes() - peak);
+
+    peak = peak_bytes();
+    start = now_seconds();
+    result = dectalk_synthesize_audio(chapter, &audio);
+    double memorySeconds = now_seconds() - start;
+    if (result != DECtalkErrorNone) {
+        fprintf(stderr, "dectalk_synthesize_audio failed: %d\n", result);
+        return 1;
+    }
+    int32_t memorySamples = dectalk_audio_get_sample_count(audio);
+    report("in memory", memorySeconds, memorySamples, peak_bytes() - peak);
+    dectalk_audio_free(audio);
+    audio = NULL;
+
+    // In memory, then copied out and written with a WAV writer in one go
+    peak = peak_bytes();
+    start = now_seconds();
+    dectalk_synthesize_audio(chapter, &audio);
+    int32_t count = dectalk_audio_get_sample_count(audio);
+    int16_t *samples = (int16_t*)malloc((size_t)count * sizeof(int16_t));
+    dectalk_audio_copy(audio, 0, samples, count);
+    dectalk_wav_writer_t *writer = dectalk_wav_writer_open(path, DECTALK_SAMPLE_RATE);
+    dectalk_wav_writer_write(writer, samples, count);
+    dectalk_wav_writer_close(writer);
+    double thenWriteSeconds = now_seconds() - start;
+    report("in memory, then write", thenWriteSeconds, count, peak_bytes() - peak);
+    free(samples);
+    dectalk_audio_free(audio);
+
+    unlink(path);
+    free(chapter);
+    dectalk_shutdown();
+    return 0;
+}
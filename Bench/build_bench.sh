@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Build script for the bridge benchmarks on macOS
+# Each bench_*.c is linked with the bridge sources in Shared and lib/libdectalk.a
+# Run the results from Bench/build/bin; the dictionary is copied next to them
+# the way the app bundle lays it out, so benchmarks that start the engine find it.
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+ROOT_DIR="$SCRIPT_DIR/.."
+OUTPUT_DIR="$SCRIPT_DIR/build/bin"
+RESOURCES_DIR="$SCRIPT_DIR/build/Resources"
+
+# Compiler flags
+CC=clang
+CFLAGS="-O2 -mmacosx-version-min=14.0"
+INCLUDES="-I$ROOT_DIR/Shared"
+LIBS="$ROOT_DIR/lib/libdectalk.a -lm"
+
+mkdir -p "$OUTPUT_DIR" "$RESOURCES_DIR"
+cp "$ROOT_DIR/Shared/dtalk_us.dic" "$RESOURCES_DIR/"
+
+for src in "$SCRIPT_DIR"/bench_*.c; do
+    name=$(basename "$src" .c)
+    echo "Building $name..."
+    $CC $CFLAGS $INCLUDES "$src" "$ROOT_DIR"/Shared/*.c $LIBS -o "$OUTPUT_DIR/$name"
+done
+
+echo ""
+echo "Build complete!"
+echo "Benchmarks: $OUTPUT_DIR"
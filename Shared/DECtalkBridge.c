@@ -8,9 +8,17 @@
 #include "dectalk/dtk/ttsapi.h"
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <mach-o/dyld.h>
 #include <libgen.h>
 #include <limits.h>
@@ -21,21 +29,228 @@
 #define MAX_PHONEMES 128
 #define MAX_INDEX_MARKS 128
 
-// Thread-safe synthesis state
-static LPTTS_HANDLE_T g_ttsHandle = NULL;
-static DECtalkVoice g_currentVoice = DECtalkVoicePaul;
-static bool g_initialized = false;
-static bool g_inMemoryOpen = false;
+// Default speaking rate of the DECtalk engine (words per minute)
+#define DEFAULT_RATE 180
+
+// Callback routing slots, shared by pool engines and context engines
+#define MAX_ENGINE_SLOTS 64
+
+// Per-request synthesis settings
+typedef struct {
+    DECtalkVoice voice;
+    int rate;
+    int volume;     // -1 = engine default
+    int outputRate; // Sample rate delivered to the caller
+} DECtalkSettings;
+
+// Request text with its index marks renumbered 1, 2, ... in order, so every mark
+// the engine reports can be traced back to the request text, see marked_text_build
+typedef struct {
+    int32_t value;          // Value of the [:index mark] command, -1 for a word, MARK_END
+    int32_t textOffset;
+    int32_t textLength;
+} DECtalkMarkSource;
+
+// Source of the mark appended after the text to find where speech ends
+#define MARK_END INT32_MIN
+
+typedef struct {
+    char *text;
+    DECtalkMarkSource *sources;
+    int32_t count;
+} DECtalkMarkedText;
+
+// Where a request's audio goes: streamed to callback if set, otherwise
+// copied into buffer and clamped to its size
+// Index marks and phonemes are collected into timeline if set, as options ask;
+// such requests bypass the cache.
+// With a resampler the engine's samples are converted to sampleRate on the way,
+// and timeline offsets are scaled to match.
+// Float output goes to floatCallback or floatBuffer instead, through a pipeline
+// built from gain and dcBlock that also does any resampling.
+// stopRequested is polled on the output path; once it returns true the engine is
+// reset and the rest of the text is skipped, see engine_output_stopped.
+typedef struct {
+    int16_t *buffer;
+    int32_t bufferSize;
+    DECtalkAudioCallback callback;
+    void *userData;
+    int32_t samplesWritten;
+    uint32_t options;                   // DECtalkSynthesisOption flags
+    dectalk_audio_t *timeline;
+    const DECtalkMarkedText *marked;
+    int32_t speechEnd;                  // Latest end of speech seen in the timing data
+    int engineRate;                     // Rate of the engine's samples and sample numbers
+    int sampleRate;
+    dectalk_resampler_t *resampler;
+    int16_t *resampled;                 // Scratch for RESAMPLE_CHUNK samples of resampler output
+    float *floatBuffer;
+    DECtalkFloatCallback floatCallback;
+    float gain;
+    bool dcBlock;
+    dectalk_float_pipeline_t *pipeline;
+    float *floats;                      // Scratch for RESAMPLE_CHUNK samples of pipeline output
+    int16_t *held;                      // Silence held back by the trimmer, TRIM_HOLD samples
+    int32_t heldCount;
+    int32_t trimPad;                    // Engine samples of silence kept next to speech
+    bool heardSound;
+    int32_t trimmedLeading;             // Engine samples dropped before and after the speech
+    int32_t trimmedTrailing;
+    bool (*stopRequested)(void *userData);
+    bool stopped;                       // Stop seen and the engine reset
+} DECtalkOutput;
+
+// Engine samples resampled per step, bounding the scratch buffer
+#define RESAMPLE_CHUNK 1024
+
+// Silence trimming, see DECtalkOptionTrimSilence
+// Samples within TRIM_THRESHOLD of zero (about -54 dBFS) are silence. TRIM_PAD_MS
+// of silence is kept next to the speech, and a silent run longer than TRIM_HOLD
+// samples is a pause inside the speech rather than its end, so it is let through.
+#define TRIM_THRESHOLD 64
+#define TRIM_PAD_MS 10
+#define TRIM_HOLD 8192
+
+// Maximum number of caller-owned buffers, see dectalk_context_set_buffers
+#define MAX_CALLER_BUFFERS 16
+
+// A caller-owned memory region wrapped as an engine buffer
+typedef struct {
+    TTS_BUFFER_T ttsBuffer;
+    _Atomic bool held;          // Handed to the caller and not returned yet
+} DECtalkCallerBuffer;
+
+// Zero-copy synthesis state, changed with compare-exchange by the synthesizing
+// thread and by dectalk_context_return_buffer on any thread
+typedef enum {
+    CallerBuffersIdle,
+    CallerBuffersActive,        // A synthesis is running, returned buffers go straight to the engine
+    CallerBuffersBusy,          // Buffers are being queued or returned, wait for it to finish
+} DECtalkCallerBufferState;
+
+// A single DECtalk engine instance with its own set of in-memory buffers.
+// Engines are independent, so several can synthesize concurrently.
+typedef struct {
+    int slot;                   // Index in g_engines, passed to the callback as instance data
+    LPTTS_HANDLE_T ttsHandle;
+    bool pooled;                // Part of the shared pool rather than owned by a context
+    bool ready;                 // Startup finished
+    bool busy;                  // Owned by a synthesis call (or still starting up)
+    bool inMemoryOpen;
+    DWORD inMemoryFormat;
+    DWORD streamSamples;        // Samples produced since in-memory mode was opened
+    DWORD requestBase;          // streamSamples when the current request started
+    bool resetPending;          // Reset requested while busy; close in-memory mode on release
+    _Atomic bool interrupted;   // Reset during the current request, its audio is incomplete
+
+    // Output of the synthesis in progress
+    DECtalkOutput *output;
+
+    // Copy of the request's audio for the cache, dropped once it outgrows an entry
+    int16_t *captureSamples;
+    int32_t captureCount;
+    int32_t captureCapacity;
+    int64_t captureLimit;       // In samples
+    bool capturing;
+
+    // Zero-copy output: the engine fills callerBuffers and hands them to bufferCallback
+    DECtalkCallerBuffer callerBuffers[MAX_CALLER_BUFFERS];
+    int32_t callerBufferCount;
+    DECtalkBufferCallback bufferCallback;
+    void *bufferUserData;
+    _Atomic int callerBufferState;  // DECtalkCallerBufferState
+
+    // Internal buffers for in-memory synthesis
+    TTS_BUFFER_T ttsBuffers[NUM_BUFFERS];
+    char bufferData[NUM_BUFFERS][BUFFER_SIZE];
+    TTS_INDEX_T indexData[NUM_BUFFERS][MAX_INDEX_MARKS];
+    TTS_PHONEME_T phonemeData[NUM_BUFFERS][MAX_PHONEMES];
+} DECtalkEngine;
+
+// Single-producer/single-consumer ring of samples
+// The synthesizing thread writes, a real-time consumer reads, neither takes a lock.
+// Indices grow monotonically and are masked on access; capacity is a power of two.
+typedef struct {
+    int16_t *data;
+    uint32_t capacity;
+    uint32_t mask;
+    _Atomic uint32_t writeIndex;
+    char padding[64];           // Keep the indices on separate cache lines
+    _Atomic uint32_t readIndex;
+    _Atomic uint32_t discardIndex;      // Samples before this were cancelled, readers skip them
+    _Atomic bool producerDone;
+    _Atomic int state;                  // DECtalkRingState
+} DECtalkRing;
+
+// Producer state of a ring, changed with compare-exchange by the producer and
+// dectalk_ring_cancel
+typedef enum {
+    RingIdle,
+    RingActive,
+    RingCancelled,              // Active, and the cancel has not been seen by the producer yet
+    RingArmed,                  // Idle, and the next text is cancelled before it starts
+} DECtalkRingState;
+
+// Growable synthesis result, see dectalk_synthesize_audio
+// Samples are appended to chunks that double in size, so nothing is ever moved
+// and no worst-case size has to be guessed up front.
+#define AUDIO_FIRST_CHUNK 16384
+#define AUDIO_MAX_CHUNK (1 << 20)
+
+typedef struct {
+    int32_t count;
+    int32_t capacity;
+    int16_t samples[];
+} DECtalkAudioChunk;
+
+struct dectalk_audio {
+    DECtalkAudioChunk **chunks;
+    int32_t chunkCount;
+    int32_t chunkCapacity;
+    int32_t sampleCount;
+    bool allocFailed;
+
+    // Index mark and phoneme timelines, if requested
+    DECtalkIndexMark *marks;
+    int32_t markCount;
+    int32_t markCapacity;
+    DECtalkPhoneme *phonemes;
+    int32_t phonemeCount;
+    int32_t phonemeCapacity;
+
+    // Silence removed by DECtalkOptionTrimSilence, in samples of the result
+    int32_t trimmedLeading;
+    int32_t trimmedTrailing;
+
+    int32_t speechEnd;          // Where speech ends, see dectalk_audio_get_speech_end
+};
+
+// Per-context state, see dectalk_context_create
+struct dectalk_context {
+    DECtalkEngine *engine;
+    DECtalkSettings settings;
+    DECtalkRing *ring;
+};
+
+// Engine registry and pool, guarded by g_mutex
+static DECtalkEngine *g_engines[MAX_ENGINE_SLOTS];
+static int g_poolCount = 0;
+static int g_poolSize = 1;
 static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_engineAvailable = PTHREAD_COND_INITIALIZER;
+static _Atomic bool g_initialized = false;   // Also read without the lock to skip dectalk_init
+static char *g_dictionaryPath = NULL;
 
-// Callback-based synthesis state
-static int16_t *g_outputBuffer = NULL;
-static int32_t g_outputBufferSize = 0;
-static int32_t g_outputSamplesWritten = 0;
+// Background warm-up state, guarded by g_mutex, see dectalk_warm_up
+static pthread_cond_t g_warmChanged = PTHREAD_COND_INITIALIZER;
+static bool g_warming = false;
+static bool g_warm = false;
+static int g_warmResult = DECtalkErrorNone;
 
-// Internal buffers for in-memory synthesis
-static TTS_BUFFER_T g_ttsBuffers[NUM_BUFFERS];
-static char g_bufferData[NUM_BUFFERS][BUFFER_SIZE];
+// Settings applied to whichever pool engine handles a request, guarded by
+// g_settingsMutex; requests take a copy with settings_snapshot
+static pthread_mutex_t g_settingsMutex = PTHREAD_MUTEX_INITIALIZER;
+static DECtalkSettings g_settings = { DECtalkVoicePaul, DEFAULT_RATE, -1, DECTALK_SAMPLE_RATE };
 
 // Voice command strings for DECtalk
 static const char* g_voiceCommands[] = {
@@ -62,30 +277,329 @@ static const char* g_voiceNames[] = {
     "Wendy"
 };
 
-// Callback function for DECtalk TTS messages
-static void ttsCallback(LONG lParam1, LONG lParam2, DWORD dwInstanceData, UINT uiMsg) {
-    // Handle buffer messages - audio data available
-    if (uiMsg == TTS_MSG_BUFFER) {
-        LPTTS_BUFFER_T pBuf = (LPTTS_BUFFER_T)lParam2;
-        if (pBuf && pBuf->dwBufferLength > 0 && g_outputBuffer) {
-            // Copy audio data to output buffer
-            int32_t samplesToWrite = pBuf->dwBufferLength / sizeof(int16_t);
-            int32_t remainingSpace = g_outputBufferSize - g_outputSamplesWritten;
+// Stream samples to the output's callback as is, or append them to its buffer clamped to its size
+static void output_deliver(DECtalkOutput *output, const int16_t *samples, int32_t count) {
+    if (output->callback) {
+        output->callback((int16_t*)samples, count, output->userData);
+        output->samplesWritten += count;
+        return;
+    }
+
+    int32_t remainingSpace = output->bufferSize - output->samplesWritten;
+    if (count > remainingSpace) {
+        count = remainingSpace;
+    }
+
+    if (count > 0 && output->buffer) {
+        memcpy(output->buffer + output->samplesWritten, samples, count * sizeof(int16_t));
+        output->samplesWritten += count;
+    }
+}
+
+static bool output_is_float(const DECtalkOutput *output) {
+    return output->floatCallback || output->floatBuffer;
+}
 
-            if (samplesToWrite > remainingSpace) {
-                samplesToWrite = remainingSpace;
+// Pass float samples to the output's callback, or append them to its buffer clamped to its size
+static void output_deliver_float(DECtalkOutput *output, const float *samples, int32_t count) {
+    if (output->floatCallback) {
+        output->floatCallback(samples, count, output->userData);
+        output->samplesWritten += count;
+        return;
+    }
+
+    int32_t remainingSpace = output->bufferSize - output->samplesWritten;
+    if (count > remainingSpace) {
+        count = remainingSpace;
+    }
+    if (count > 0) {
+        memcpy(output->floatBuffer + output->samplesWritten, samples, count * sizeof(float));
+        output->samplesWritten += count;
+    }
+}
+
+// Run engine samples through the output's float pipeline
+// While the caller's buffer has room the pipeline writes it directly
+static void output_write_float(DECtalkOutput *output, const int16_t *samples, int32_t count) {
+    while (count > 0) {
+        int32_t n = count < RESAMPLE_CHUNK ? count : RESAMPLE_CHUNK;
+        if (!output->floatCallback &&
+            dectalk_float_pipeline_max_output(output->pipeline, n) <= output->bufferSize - output->samplesWritten) {
+            output->samplesWritten += dectalk_float_pipeline_process(output->pipeline, samples, n,
+                                                                     output->floatBuffer + output->samplesWritten);
+        } else {
+            int32_t produced = dectalk_float_pipeline_process(output->pipeline, samples, n, output->floats);
+            if (produced > 0) {
+                output_deliver_float(output, output->floats, produced);
             }
+        }
+        samples += n;
+        count -= n;
+    }
+}
+
+// Pass engine samples to the output, resampled to its rate if needed
+static void output_convert(DECtalkOutput *output, const int16_t *samples, int32_t count) {
+    if (output->pipeline) {
+        output_write_float(output, samples, count);
+        return;
+    }
+    if (!output->resampler) {
+        output_deliver(output, samples, count);
+        return;
+    }
+
+    while (count > 0) {
+        int32_t n = count < RESAMPLE_CHUNK ? count : RESAMPLE_CHUNK;
+        int32_t produced = dectalk_resampler_process(output->resampler, samples, n, output->resampled);
+        if (produced > 0) {
+            output_deliver(output, output->resampled, produced);
+        }
+        samples += n;
+        count -= n;
+    }
+}
 
-            if (samplesToWrite > 0) {
-                memcpy(g_outputBuffer + g_outputSamplesWritten,
-                       pBuf->lpData,
-                       samplesToWrite * sizeof(int16_t));
-                g_outputSamplesWritten += samplesToWrite;
+// Keep the last trimPad samples of the silence before the speech
+static void trim_hold_leading(DECtalkOutput *output, const int16_t *samples, int32_t count) {
+    int32_t pad = output->trimPad;
+    if (count >= pad) {
+        output->trimmedLeading += output->heldCount + count - pad;
+        memcpy(output->held, samples + count - pad, (size_t)pad * sizeof(int16_t));
+        output->heldCount = pad;
+        return;
+    }
+
+    int32_t drop = output->heldCount + count - pad;
+    if (drop > 0) {
+        output->trimmedLeading += drop;
+        output->heldCount -= drop;
+        memmove(output->held, output->held + drop, (size_t)output->heldCount * sizeof(int16_t));
+    }
+    memcpy(output->held + output->heldCount, samples, (size_t)count * sizeof(int16_t));
+    output->heldCount += count;
+}
+
+// Hold back silence after speech; what no longer fits is a pause and goes out
+static void trim_hold(DECtalkOutput *output, const int16_t *samples, int32_t count) {
+    if (output->heldCount + count > TRIM_HOLD) {
+        output_convert(output, output->held, output->heldCount);
+        output->heldCount = 0;
+    }
+    if (count > TRIM_HOLD) {
+        output_convert(output, samples, count - TRIM_HOLD);
+        samples += count - TRIM_HOLD;
+        count = TRIM_HOLD;
+    }
+    memcpy(output->held + output->heldCount, samples, (size_t)count * sizeof(int16_t));
+    output->heldCount += count;
+}
+
+// Pass engine samples to the output, trimming silence if the request asks for it
+static void output_write(DECtalkOutput *output, const int16_t *samples, int32_t count) {
+    if (!output->held) {
+        output_convert(output, samples, count);
+        return;
+    }
+
+    if (!output->heardSound) {
+        int32_t first = dectalk_find_first_sound(samples, count, TRIM_THRESHOLD);
+        if (first < 0) {
+            trim_hold_leading(output, samples, count);
+            return;
+        }
+        trim_hold_leading(output, samples, first);
+        output_convert(output, output->held, output->heldCount);
+        output->heldCount = 0;
+        output->heardSound = true;
+        samples += first;
+        count -= first;
+    }
+
+    int32_t last = dectalk_find_last_sound(samples, count, TRIM_THRESHOLD);
+    if (last < 0) {
+        trim_hold(output, samples, count);
+        return;
+    }
+    if (output->heldCount > 0) {
+        output_convert(output, output->held, output->heldCount);
+        output->heldCount = 0;
+    }
+    output_convert(output, samples, last + 1);
+    trim_hold(output, samples + last + 1, count - last - 1);
+}
+
+// End of the request: keep the pad after the speech and drop the rest
+static void trim_finish(DECtalkOutput *output) {
+    if (!output->heardSound) {
+        output->trimmedLeading += output->heldCount;
+        output->heldCount = 0;
+        return;
+    }
+
+    int32_t keep = output->heldCount < output->trimPad ? output->heldCount : output->trimPad;
+    output_convert(output, output->held, keep);
+    output->trimmedTrailing = output->heldCount - keep;
+    output->heldCount = 0;
+}
+
+// Engine sample offset in the output's samples
+static int32_t output_offset(const DECtalkOutput *output, int32_t offset) {
+    if (output->sampleRate == output->engineRate) {
+        return offset;
+    }
+    return (int32_t)((int64_t)offset * output->sampleRate / output->engineRate);
+}
+
+static void engine_capture(DECtalkEngine *engine, const int16_t *samples, int32_t count);
+static void audio_append_mark(dectalk_audio_t *audio, const DECtalkIndexMark *mark);
+static void audio_append_phoneme(dectalk_audio_t *audio, const DECtalkPhoneme *phoneme);
+
+// Add the buffer's index marks to the request's timeline
+static void engine_write_marks(DECtalkEngine *engine, LPTTS_BUFFER_T pBuf) {
+    DECtalkOutput *output = engine->output;
+    if (!output || !output->timeline) {
+        return;
+    }
+    bool collect = (output->options & (DECtalkOptionIndexMarks | DECtalkOptionWordMarks)) != 0;
+
+    const DECtalkMarkedText *marked = output->marked;
+    for (DWORD i = 0; i < pBuf->dwNumberOfIndexMarks && i < pBuf->dwMaximumNumberOfIndexMarks; i++) {
+        const TTS_INDEX_T *index = &pBuf->lpIndexArray[i];
+
+        // Sample numbers count from when in-memory mode was opened
+        DECtalkIndexMark mark = {
+            output_offset(output, (int32_t)(index->dwIndexSampleNumber - engine->requestBase)),
+            (int32_t)index->dwIndexValue, -1, 0
+        };
+        if (marked && index->dwIndexValue >= 1 && index->dwIndexValue <= (DWORD)marked->count) {
+            const DECtalkMarkSource *source = &marked->sources[index->dwIndexValue - 1];
+            if (source->value == MARK_END) {
+                if (mark.sampleOffset > output->speechEnd) {
+                    output->speechEnd = mark.sampleOffset;
+                }
+                continue;
             }
+            mark.value = source->value;
+            mark.textOffset = source->textOffset;
+            mark.textLength = source->textLength;
+        }
+        if (collect) {
+            audio_append_mark(output->timeline, &mark);
+        }
+    }
+}
 
-            // Re-queue the buffer
-            pBuf->dwBufferLength = 0;
-            TextToSpeechAddBuffer(g_ttsHandle, pBuf);
+// Add the buffer's phoneme changes to the request's timeline
+static void engine_write_phonemes(DECtalkEngine *engine, LPTTS_BUFFER_T pBuf) {
+    DECtalkOutput *output = engine->output;
+    if (!output || !output->timeline) {
+        return;
+    }
+
+    for (DWORD i = 0; i < pBuf->dwNumberOfPhonemeChanges && i < pBuf->dwMaximumNumberOfPhonemeChanges; i++) {
+        const TTS_PHONEME_T *change = &pBuf->lpPhonemeArray[i];
+        int32_t offset = (int32_t)(change->dwPhonemeSampleNumber - engine->requestBase);
+        DECtalkPhoneme phoneme = {
+            (int32_t)change->dwPhoneme,
+            output_offset(output, offset),
+            (int32_t)change->dwPhonemeDuration
+        };
+
+        int32_t end = output_offset(output, offset +
+                                    (int32_t)((int64_t)phoneme.durationMs * output->engineRate / 1000));
+        if (end > output->speechEnd) {
+            output->speechEnd = end;
+        }
+
+        if (output->options & DECtalkOptionPhonemes) {
+            audio_append_phoneme(output->timeline, &phoneme);
+        }
+    }
+}
+
+// Check the request's stop condition; the first time it holds, reset the engine
+// so the rest of the text is skipped and its partial audio is not cached
+static bool engine_output_stopped(DECtalkEngine *engine) {
+    DECtalkOutput *output = engine->output;
+    if (!output || !output->stopRequested) {
+        return false;
+    }
+    if (!output->stopped && output->stopRequested(output->userData)) {
+        output->stopped = true;
+        atomic_store(&engine->interrupted, true);
+        TextToSpeechReset(engine->ttsHandle, FALSE);
+    }
+    return output->stopped;
+}
+
+// Hand a filled buffer to the engine's output
+// Returns false if the caller kept a zero-copy buffer, which must then not be re-queued
+static bool engine_write_output(DECtalkEngine *engine, LPTTS_BUFFER_T pBuf) {
+    if (engine_output_stopped(engine)) {
+        // Whatever the engine still had in flight is dropped
+        pBuf->dwNumberOfIndexMarks = 0;
+        pBuf->dwNumberOfPhonemeChanges = 0;
+        return true;
+    }
+    if (pBuf->dwNumberOfIndexMarks > 0) {
+        engine_write_marks(engine, pBuf);
+        pBuf->dwNumberOfIndexMarks = 0;
+    }
+    if (pBuf->dwNumberOfPhonemeChanges > 0) {
+        engine_write_phonemes(engine, pBuf);
+        pBuf->dwNumberOfPhonemeChanges = 0;
+    }
+
+    if (pBuf->dwBufferLength == 0) {
+        return true;
+    }
+
+    int32_t samplesToWrite = pBuf->dwBufferLength / sizeof(int16_t);
+    engine->streamSamples += (DWORD)samplesToWrite;
+
+    if (engine->bufferCallback) {
+        // TTS_BUFFER_T is the first member, so this recovers the caller buffer
+        DECtalkCallerBuffer *callerBuffer = (DECtalkCallerBuffer*)pBuf;
+
+        atomic_store(&callerBuffer->held, true);
+        if (engine->bufferCallback((int16_t*)pBuf->lpData, samplesToWrite, engine->bufferUserData)) {
+            return false;
+        }
+        atomic_store(&callerBuffer->held, false);
+        return true;
+    }
+
+    if (engine->capturing) {
+        engine_capture(engine, (const int16_t*)pBuf->lpData, samplesToWrite);
+    }
+    if (engine->output) {
+        output_write(engine->output, (const int16_t*)pBuf->lpData, samplesToWrite);
+    }
+    return true;
+}
+
+// Callback function for DECtalk TTS messages
+// dwInstanceData is the slot of the engine that produced the message
+static void ttsCallback(LONG lParam1, LONG lParam2, DWORD dwInstanceData, UINT uiMsg) {
+    (void)lParam1;
+
+    if (dwInstanceData >= MAX_ENGINE_SLOTS) {
+        return;
+    }
+    DECtalkEngine *engine = g_engines[dwInstanceData];
+
+    // Handle buffer messages - audio data available
+    if (uiMsg == TTS_MSG_BUFFER && engine) {
+        LPTTS_BUFFER_T pBuf = (LPTTS_BUFFER_T)lParam2;
+        if (pBuf && (pBuf->dwBufferLength > 0 ||
+                     pBuf->dwNumberOfIndexMarks > 0 ||
+                     pBuf->dwNumberOfPhonemeChanges > 0)) {
+            // Re-queue the buffer unless the caller kept it
+            if (engine_write_output(engine, pBuf)) {
+                pBuf->dwBufferLength = 0;
+                TextToSpeechAddBuffer(engine->ttsHandle, pBuf);
+            }
         }
     }
 }
@@ -124,255 +638,1050 @@ static char* get_dictionary_path(void) {
     }
 }
 
-int dectalk_init(void) {
-    pthread_mutex_lock(&g_mutex);
-
-    if (g_initialized) {
-        pthread_mutex_unlock(&g_mutex);
-        return DECtalkErrorNone;
-    }
-
+// Start a DECtalk engine in the given slot
+// The engine must already be registered in g_engines so callbacks can find it
+static int engine_start(DECtalkEngine *engine) {
     // Initialize buffers
     for (int i = 0; i < NUM_BUFFERS; i++) {
-        memset(&g_ttsBuffers[i], 0, sizeof(TTS_BUFFER_T));
-        g_ttsBuffers[i].lpData = g_bufferData[i];
-        g_ttsBuffers[i].dwMaximumBufferLength = BUFFER_SIZE;
-        g_ttsBuffers[i].lpPhonemeArray = NULL;
-        g_ttsBuffers[i].lpIndexArray = NULL;
-        g_ttsBuffers[i].dwMaximumNumberOfPhonemeChanges = 0;
-        g_ttsBuffers[i].dwMaximumNumberOfIndexMarks = 0;
+        memset(&engine->ttsBuffers[i], 0, sizeof(TTS_BUFFER_T));
+        engine->ttsBuffers[i].lpData = engine->bufferData[i];
+        engine->ttsBuffers[i].dwMaximumBufferLength = BUFFER_SIZE;
+        engine->ttsBuffers[i].lpPhonemeArray = engine->phonemeData[i];
+        engine->ttsBuffers[i].lpIndexArray = engine->indexData[i];
+        engine->ttsBuffers[i].dwMaximumNumberOfPhonemeChanges = MAX_PHONEMES;
+        engine->ttsBuffers[i].dwMaximumNumberOfIndexMarks = MAX_INDEX_MARKS;
     }
 
-    // Get the path to the dictionary file
-    char *dict_path = get_dictionary_path();
-
     // Start DECtalk with no audio device (we'll use in-memory mode)
     // Use TextToSpeechStartupExFonix to specify the dictionary path
     DWORD devOptions = DO_NOT_USE_AUDIO_DEVICE;
-    MMRESULT result = TextToSpeechStartupExFonix(&g_ttsHandle,
+    MMRESULT result = TextToSpeechStartupExFonix(&engine->ttsHandle,
                                                   WAVE_MAPPER,
                                                   devOptions,
                                                   (void (*)(LONG, LONG, DWORD, UINT))ttsCallback,
-                                                  0,
-                                                  dict_path);
+                                                  (LONG)engine->slot,
+                                                  g_dictionaryPath);
 
     if (result != MMSYSERR_NOERROR) {
         fprintf(stderr, "DECtalk TextToSpeechStartupExFonix failed: %d\n", result);
-        pthread_mutex_unlock(&g_mutex);
+        engine->ttsHandle = NULL;
         return DECtalkErrorInitFailed;
     }
 
-    g_initialized = true;
-    g_currentVoice = DECtalkVoicePaul;
+    return DECtalkErrorNone;
+}
 
-    fprintf(stderr, "DECtalk: Initialization successful!\n");
+static void engine_stop(DECtalkEngine *engine) {
+    if (engine->ttsHandle) {
+        if (engine->inMemoryOpen) {
+            TextToSpeechCloseInMemory(engine->ttsHandle);
+            engine->inMemoryOpen = false;
+        }
+        TextToSpeechShutdown(engine->ttsHandle);
+        engine->ttsHandle = NULL;
+    }
+}
 
-    pthread_mutex_unlock(&g_mutex);
-    return DECtalkErrorNone;
+// Allocate an engine in a free slot. Caller holds g_mutex.
+// The engine is returned busy and not yet ready.
+static DECtalkEngine *engine_register_locked(bool pooled) {
+    for (int slot = 0; slot < MAX_ENGINE_SLOTS; slot++) {
+        if (g_engines[slot] == NULL) {
+            DECtalkEngine *engine = (DECtalkEngine*)calloc(1, sizeof(DECtalkEngine));
+            if (!engine) {
+                return NULL;
+            }
+            engine->slot = slot;
+            engine->pooled = pooled;
+            engine->busy = true;
+            g_engines[slot] = engine;
+            if (pooled) {
+                g_poolCount++;
+            }
+            return engine;
+        }
+    }
+    return NULL;
 }
 
-void dectalk_shutdown(void) {
+// Free an engine's slot once it is stopped or failed to start. Caller holds g_mutex.
+static void engine_unregister_locked(DECtalkEngine *engine) {
+    g_engines[engine->slot] = NULL;
+    if (engine->pooled) {
+        g_poolCount--;
+        pthread_cond_broadcast(&g_engineAvailable);
+    }
+    free(engine->captureSamples);
+    free(engine);
+}
+
+// Resolve the dictionary path once. Caller holds g_mutex.
+static void load_dictionary_path_locked(void) {
+    if (!g_dictionaryPath) {
+        g_dictionaryPath = get_dictionary_path();
+    }
+}
+
+// Get an idle engine, starting a new one if the pool has room,
+// otherwise wait until another request releases one
+static DECtalkEngine *pool_acquire(void) {
     pthread_mutex_lock(&g_mutex);
 
-    if (g_initialized && g_ttsHandle) {
-        if (g_inMemoryOpen) {
-            TextToSpeechCloseInMemory(g_ttsHandle);
-            g_inMemoryOpen = false;
+    while (g_initialized) {
+        for (int slot = 0; slot < MAX_ENGINE_SLOTS; slot++) {
+            DECtalkEngine *engine = g_engines[slot];
+            if (engine && engine->pooled && engine->ready && !engine->busy) {
+                engine->busy = true;
+                pthread_mutex_unlock(&g_mutex);
+                return engine;
+            }
         }
-        TextToSpeechShutdown(g_ttsHandle);
-        g_ttsHandle = NULL;
-        g_initialized = false;
+
+        if (g_poolCount < g_poolSize) {
+            DECtalkEngine *engine = engine_register_locked(true);
+            if (engine) {
+                // Startup loads the dictionary, don't block other requests meanwhile
+                pthread_mutex_unlock(&g_mutex);
+                int result = engine_start(engine);
+                pthread_mutex_lock(&g_mutex);
+
+                if (result != DECtalkErrorNone) {
+                    engine_unregister_locked(engine);
+                    pthread_mutex_unlock(&g_mutex);
+                    return NULL;
+                }
+                engine->ready = true;
+                pthread_mutex_unlock(&g_mutex);
+                return engine;
+            }
+        }
+
+        pthread_cond_wait(&g_engineAvailable, &g_mutex);
     }
 
     pthread_mutex_unlock(&g_mutex);
+    return NULL;
 }
 
-int dectalk_set_voice(DECtalkVoice voice) {
-    if (voice < 0 || voice >= DECtalkVoiceCount) {
-        return DECtalkErrorInvalidVoice;
-    }
-    g_currentVoice = voice;
+static void pool_release(DECtalkEngine *engine) {
+    pthread_mutex_lock(&g_mutex);
 
-    // If initialized, set speaker immediately
-    if (g_initialized && g_ttsHandle) {
-        TextToSpeechSetSpeaker(g_ttsHandle, (SPEAKER_T)voice);
+    if (engine->resetPending) {
+        if (engine->inMemoryOpen) {
+            TextToSpeechCloseInMemory(engine->ttsHandle);
+            engine->inMemoryOpen = false;
+        }
+        engine->resetPending = false;
     }
 
-    return DECtalkErrorNone;
+    engine->output = NULL;
+    engine->busy = false;
+    pthread_cond_broadcast(&g_engineAvailable);
+
+    pthread_mutex_unlock(&g_mutex);
 }
 
-DECtalkVoice dectalk_get_voice(void) {
-    return g_currentVoice;
+// Apply request settings to an engine
+// Inline commands from a previous request may have changed them
+static void engine_apply_settings(DECtalkEngine *engine, const DECtalkSettings *settings) {
+    TextToSpeechSetSpeaker(engine->ttsHandle, (SPEAKER_T)settings->voice);
+    TextToSpeechSetRate(engine->ttsHandle, (DWORD)settings->rate);
+
+    if (settings->volume >= 0) {
+        // Set both left and right channels
+        DWORD vol = (DWORD)settings->volume;
+        vol = vol | (vol << 16);
+        TextToSpeechSetVolume(engine->ttsHandle, VOLUME_MAIN, vol);
+    }
 }
 
-int dectalk_synthesize(const char *text, int16_t *buffer, int32_t bufferSize, int32_t *samplesWritten) {
-    pthread_mutex_lock(&g_mutex);
+// Rate the engine runs at for the settings: natively at 8 kHz when that is
+// the output rate, otherwise at DECTALK_SAMPLE_RATE with the output resampled
+static int engine_sample_rate(const DECtalkSettings *settings) {
+    return settings->outputRate == DECTALK_SAMPLE_RATE_8K ? DECTALK_SAMPLE_RATE_8K : DECTALK_SAMPLE_RATE;
+}
 
-    if (!g_initialized) {
-        pthread_mutex_unlock(&g_mutex);
-        int result = dectalk_init();
-        if (result != DECtalkErrorNone) {
-            return result;
-        }
-        pthread_mutex_lock(&g_mutex);
+static DWORD engine_wave_format(const DECtalkSettings *settings) {
+    return engine_sample_rate(settings) == DECTALK_SAMPLE_RATE_8K ? WAVE_FORMAT_08M16 : WAVE_FORMAT_1M16;
+}
+
+// Move the caller buffers from state to Busy, waiting out a return in progress
+static void caller_buffers_begin(DECtalkEngine *engine, int state) {
+    int expected = state;
+    while (!atomic_compare_exchange_weak(&engine->callerBufferState, &expected, CallerBuffersBusy)) {
+        expected = state;
     }
+}
 
-    if (text == NULL || buffer == NULL || samplesWritten == NULL) {
-        pthread_mutex_unlock(&g_mutex);
-        return DECtalkErrorSynthFailed;
+// Stop handing returned caller buffers to the engine; from here on they wait
+// for the next synthesis to queue them
+static void caller_buffers_end(DECtalkEngine *engine) {
+    if (engine->bufferCallback) {
+        caller_buffers_begin(engine, CallerBuffersActive);
+        atomic_store(&engine->callerBufferState, CallerBuffersIdle);
     }
+}
 
-    // Set up output buffer
-    g_outputBuffer = buffer;
-    g_outputBufferSize = bufferSize;
-    g_outputSamplesWritten = 0;
+// Speak text on an acquired engine and collect all of its audio
+// format is the in-memory wave format; WAVE_FORMAT_NULL produces timing data only
+static int engine_speak(DECtalkEngine *engine, const char *text, DECtalkVoice voice, DWORD format) {
+    // Reopen in-memory mode for another format. Without audio nothing advances our
+    // sample count, so a timing-only request always starts a fresh stream; without
+    // an output there are no timings and the stream is kept.
+    if (engine->inMemoryOpen && (engine->inMemoryFormat != format ||
+                                 (format == WAVE_FORMAT_NULL && engine->output))) {
+        TextToSpeechCloseInMemory(engine->ttsHandle);
+        engine->inMemoryOpen = false;
+    }
 
     // Open in-memory mode if not already open
-    if (!g_inMemoryOpen) {
-        MMRESULT result = TextToSpeechOpenInMemory(g_ttsHandle, WAVE_FORMAT_1M16);
+    if (!engine->inMemoryOpen) {
+        MMRESULT result = TextToSpeechOpenInMemory(engine->ttsHandle, format);
         if (result != MMSYSERR_NOERROR) {
             fprintf(stderr, "TextToSpeechOpenInMemory failed: %d\n", result);
-            pthread_mutex_unlock(&g_mutex);
             return DECtalkErrorSynthFailed;
         }
-        g_inMemoryOpen = true;
+        engine->inMemoryOpen = true;
+        engine->inMemoryFormat = format;
+        engine->streamSamples = 0;
     }
+    engine->requestBase = engine->streamSamples;
 
     // Reset and queue buffers
-    for (int i = 0; i < NUM_BUFFERS; i++) {
-        g_ttsBuffers[i].dwBufferLength = 0;
-        TextToSpeechAddBuffer(g_ttsHandle, &g_ttsBuffers[i]);
+    if (engine->bufferCallback) {
+        // Caller buffers still held from an earlier request are queued when returned
+        caller_buffers_begin(engine, CallerBuffersIdle);
+        for (int32_t i = 0; i < engine->callerBufferCount; i++) {
+            DECtalkCallerBuffer *callerBuffer = &engine->callerBuffers[i];
+            if (!atomic_load(&callerBuffer->held)) {
+                callerBuffer->ttsBuffer.dwBufferLength = 0;
+                TextToSpeechAddBuffer(engine->ttsHandle, &callerBuffer->ttsBuffer);
+            }
+        }
+        atomic_store(&engine->callerBufferState, CallerBuffersActive);
+    } else {
+        for (int i = 0; i < NUM_BUFFERS; i++) {
+            engine->ttsBuffers[i].dwBufferLength = 0;
+            engine->ttsBuffers[i].dwNumberOfIndexMarks = 0;
+            engine->ttsBuffers[i].dwNumberOfPhonemeChanges = 0;
+            TextToSpeechAddBuffer(engine->ttsHandle, &engine->ttsBuffers[i]);
+        }
     }
 
-    // Set the voice
-    TextToSpeechSetSpeaker(g_ttsHandle, (SPEAKER_T)g_currentVoice);
-
     // Build text with voice command prefix
-    size_t voiceCmdLen = strlen(g_voiceCommands[g_currentVoice]);
+    size_t voiceCmdLen = strlen(g_voiceCommands[voice]);
     size_t textLen = strlen(text);
     size_t totalLen = voiceCmdLen + textLen + 1;
 
     char *fullText = (char*)malloc(totalLen);
     if (!fullText) {
-        pthread_mutex_unlock(&g_mutex);
+        caller_buffers_end(engine);
         return DECtalkErrorSynthFailed;
     }
 
-    strcpy(fullText, g_voiceCommands[g_currentVoice]);
+    strcpy(fullText, g_voiceCommands[voice]);
     strcat(fullText, text);
 
     // Synthesize with TTS_FORCE to start immediately
-    MMRESULT result = TextToSpeechSpeak(g_ttsHandle, fullText, TTS_FORCE);
+    MMRESULT result = TextToSpeechSpeak(engine->ttsHandle, fullText, TTS_FORCE);
+    free(fullText);
     if (result != MMSYSERR_NOERROR) {
         fprintf(stderr, "TextToSpeechSpeak failed: %d\n", result);
-        free(fullText);
-        pthread_mutex_unlock(&g_mutex);
+        caller_buffers_end(engine);
         return DECtalkErrorSynthFailed;
     }
 
     // Sync to ensure all audio is generated
-    TextToSpeechSync(g_ttsHandle);
+    TextToSpeechSync(engine->ttsHandle);
+
+    // Buffers returned before this are queued and drained below with the rest
+    caller_buffers_end(engine);
 
     // Get any remaining buffer data
     LPTTS_BUFFER_T pLastBuffer = NULL;
-    while (TextToSpeechReturnBuffer(g_ttsHandle, &pLastBuffer) == MMSYSERR_NOERROR && pLastBuffer) {
-        if (pLastBuffer->dwBufferLength > 0) {
-            int32_t samplesToWrite = pLastBuffer->dwBufferLength / sizeof(int16_t);
-            int32_t remainingSpace = g_outputBufferSize - g_outputSamplesWritten;
+    while (TextToSpeechReturnBuffer(engine->ttsHandle, &pLastBuffer) == MMSYSERR_NOERROR && pLastBuffer) {
+        (void)engine_write_output(engine, pLastBuffer);
+        pLastBuffer = NULL;
+    }
+
+    return DECtalkErrorNone;
+}
 
-            if (samplesToWrite > remainingSpace) {
-                samplesToWrite = remainingSpace;
+// Append samples to a result, growing it chunk by chunk
+static void audio_append(dectalk_audio_t *audio, const int16_t *samples, int32_t count) {
+    while (count > 0 && !audio->allocFailed) {
+        DECtalkAudioChunk *chunk = audio->chunkCount ? audio->chunks[audio->chunkCount - 1] : NULL;
+
+        if (!chunk || chunk->count == chunk->capacity) {
+            if (audio->chunkCount == audio->chunkCapacity) {
+                int32_t newCapacity = audio->chunkCapacity ? audio->chunkCapacity * 2 : 8;
+                DECtalkAudioChunk **chunks = (DECtalkAudioChunk**)realloc(audio->chunks,
+                                                                          newCapacity * sizeof(DECtalkAudioChunk*));
+                if (!chunks) {
+                    audio->allocFailed = true;
+                    return;
+                }
+                audio->chunks = chunks;
+                audio->chunkCapacity = newCapacity;
+            }
+
+            int32_t size = chunk ? chunk->capacity * 2 : AUDIO_FIRST_CHUNK;
+            if (size > AUDIO_MAX_CHUNK) {
+                size = AUDIO_MAX_CHUNK;
             }
 
-            if (samplesToWrite > 0) {
-                memcpy(g_outputBuffer + g_outputSamplesWritten,
-                       pLastBuffer->lpData,
-                       samplesToWrite * sizeof(int16_t));
-                g_outputSamplesWritten += samplesToWrite;
+            chunk = (DECtalkAudioChunk*)malloc(sizeof(DECtalkAudioChunk) + size * sizeof(int16_t));
+            if (!chunk) {
+                audio->allocFailed = true;
+                return;
             }
+            chunk->count = 0;
+            chunk->capacity = size;
+            audio->chunks[audio->chunkCount++] = chunk;
         }
-        pLastBuffer = NULL;
+
+        int32_t n = chunk->capacity - chunk->count;
+        if (n > count) {
+            n = count;
+        }
+        memcpy(chunk->samples + chunk->count, samples, n * sizeof(int16_t));
+        chunk->count += n;
+        audio->sampleCount += n;
+        samples += n;
+        count -= n;
     }
+}
 
-    free(fullText);
+static void audio_append_callback(int16_t *samples, int32_t count, void *userData) {
+    audio_append((dectalk_audio_t*)userData, samples, count);
+}
 
-    *samplesWritten = g_outputSamplesWritten;
+// Count samples without keeping them, see DECtalkOptionNoAudio
+static void audio_count_callback(int16_t *samples, int32_t count, void *userData) {
+    (void)samples;
+    ((dectalk_audio_t*)userData)->sampleCount += count;
+}
 
-    pthread_mutex_unlock(&g_mutex);
-    return DECtalkErrorNone;
+static void audio_append_phoneme(dectalk_audio_t *audio, const DECtalkPhoneme *phoneme) {
+    if (audio->phonemeCount == audio->phonemeCapacity) {
+        int32_t capacity = audio->phonemeCapacity ? audio->phonemeCapacity * 2 : 256;
+        DECtalkPhoneme *grown = (DECtalkPhoneme*)realloc(audio->phonemes, capacity * sizeof(DECtalkPhoneme));
+        if (!grown) {
+            audio->allocFailed = true;
+            return;
+        }
+        audio->phonemes = grown;
+        audio->phonemeCapacity = capacity;
+    }
+    audio->phonemes[audio->phonemeCount++] = *phoneme;
 }
 
-int dectalk_synthesize_with_callback(const char *text, DECtalkAudioCallback callback, void *userData) {
-    if (!callback) {
-        return DECtalkErrorSynthFailed;
+static void audio_append_mark(dectalk_audio_t *audio, const DECtalkIndexMark *mark) {
+    if (audio->markCount == audio->markCapacity) {
+        int32_t capacity = audio->markCapacity ? audio->markCapacity * 2 : 64;
+        DECtalkIndexMark *grown = (DECtalkIndexMark*)realloc(audio->marks, capacity * sizeof(DECtalkIndexMark));
+        if (!grown) {
+            audio->allocFailed = true;
+            return;
+        }
+        audio->marks = grown;
+        audio->markCapacity = capacity;
     }
+    audio->marks[audio->markCount++] = *mark;
+}
 
-    // Use a temporary buffer and call the callback
-    int32_t bufferSize = DECTALK_SAMPLE_RATE * 60; // 60 seconds max
-    int16_t *buffer = (int16_t*)malloc(bufferSize * sizeof(int16_t));
-    if (!buffer) {
-        return DECtalkErrorSynthFailed;
+// Finish a synthesis into a new result object
+static int audio_finish(dectalk_audio_t *audio, int result, dectalk_audio_t **out) {
+    if (result == DECtalkErrorNone && audio->allocFailed) {
+        result = DECtalkErrorBufferFull;
+    }
+    if (result != DECtalkErrorNone) {
+        dectalk_audio_free(audio);
+        return result;
     }
+    *out = audio;
+    return DECtalkErrorNone;
+}
 
-    int32_t samplesWritten = 0;
-    int result = dectalk_synthesize(text, buffer, bufferSize, &samplesWritten);
+static bool cache_deliver(const DECtalkSettings *settings, const char *text, DECtalkOutput *output);
+static void cache_capture_begin(DECtalkEngine *engine);
+static void cache_capture_end(DECtalkEngine *engine, const DECtalkSettings *settings, const char *text, bool complete);
 
-    if (result == DECtalkErrorNone && samplesWritten > 0) {
-        callback(buffer, samplesWritten, userData);
+// Match an [:index mark N] command spanning p up to close
+static bool parse_index_mark(const char *p, const char *close, int32_t *value) {
+    p++;
+    while (p < close && isspace((unsigned char)*p)) p++;
+    if (p >= close || *p != ':') {
+        return false;
+    }
+    p++;
+    while (p < close && isspace((unsigned char)*p)) p++;
+    if (close - p < 5 || strncasecmp(p, "index", 5) != 0) {
+        return false;
+    }
+    p += 5;
+    while (p < close && isspace((unsigned char)*p)) p++;
+    if (close - p < 4 || strncasecmp(p, "mark", 4) != 0) {
+        return false;
+    }
+    p += 4;
+    while (p < close && isspace((unsigned char)*p)) p++;
+    if (p >= close || !isdigit((unsigned char)*p)) {
+        return false;
     }
 
-    free(buffer);
-    return result;
-}
-
-int dectalk_extract_text_from_ssml(const char *ssml, char *plainText, int32_t maxLength) {
-    if (ssml == NULL || plainText == NULL || maxLength <= 0) {
-        return 0;
+    long parsed = 0;
+    while (p < close && isdigit((unsigned char)*p)) {
+        if (parsed < INT32_MAX / 10) {
+            parsed = parsed * 10 + (*p - '0');
+        }
+        p++;
     }
+    while (p < close && isspace((unsigned char)*p)) p++;
 
-    const char *src = ssml;
-    char *dst = plainText;
-    int32_t written = 0;
-    bool inTag = false;
+    *value = (int32_t)parsed;
+    return p == close;
+}
 
-    while (*src && written < maxLength - 1) {
-        if (*src == '<') {
-            inTag = true;
-            src++;
+// Copy text to out with index mark commands renumbered and, if words is set, a mark
+// before every word outside of commands. Sources receives where each mark came from.
+// With out NULL nothing is written. Returns the number of marks.
+static int32_t marked_text_scan(const char *text, bool words, char *out, DECtalkMarkSource *sources) {
+    int32_t count = 0;
+    size_t n = 0;
+    const char *p = text;
+
+    while (*p) {
+        if (*p == '[') {
+            const char *close = strchr(p, ']');
+            size_t length = close ? (size_t)(close - p + 1) : strlen(p);
+            int32_t value;
+            if (close && parse_index_mark(p, close, &value)) {
+                if (out) {
+                    n += sprintf(out + n, "[:index mark %d]", count + 1);
+                    sources[count] = (DECtalkMarkSource){ value, (int32_t)(p - text), (int32_t)length };
+                }
+                count++;
+            } else if (out) {
+                memcpy(out + n, p, length);
+                n += length;
+            }
+            p += length;
             continue;
         }
 
-        if (*src == '>') {
-            inTag = false;
-            src++;
+        if (words && !isspace((unsigned char)*p)) {
+            const char *end = p;
+            while (*end && *end != '[' && !isspace((unsigned char)*end)) end++;
+            if (out) {
+                n += sprintf(out + n, "[:index mark %d]", count + 1);
+                sources[count] = (DECtalkMarkSource){ -1, (int32_t)(p - text), (int32_t)(end - p) };
+                memcpy(out + n, p, end - p);
+                n += end - p;
+            }
+            count++;
+            p = end;
             continue;
         }
 
-        if (!inTag) {
-            // Handle HTML entities
-            if (*src == '&') {
-                if (strncmp(src, "&amp;", 5) == 0) {
-                    *dst++ = '&';
-                    written++;
-                    src += 5;
-                    continue;
-                } else if (strncmp(src, "&lt;", 4) == 0) {
-                    *dst++ = '<';
-                    written++;
-                    src += 4;
-                    continue;
-                } else if (strncmp(src, "&gt;", 4) == 0) {
-                    *dst++ = '>';
-                    written++;
-                    src += 4;
-                    continue;
-                } else if (strncmp(src, "&quot;", 6) == 0) {
-                    *dst++ = '"';
-                    written++;
-                    src += 6;
-                    continue;
-                } else if (strncmp(src, "&apos;", 6) == 0) {
-                    *dst++ = '\'';
+        if (out) {
+            out[n++] = *p;
+        }
+        p++;
+    }
+
+    if (out) {
+        out[n] = '\0';
+    }
+    return count;
+}
+
+// Longest renumbered command, "[:index mark 2147483647]"
+#define MARK_COMMAND_MAX 24
+
+// Renumber the marks in text, adding word marks if words is set and a mark after
+// the text if end is set
+static bool marked_text_build(DECtalkMarkedText *marked, const char *text, bool words, bool end) {
+    int32_t count = marked_text_scan(text, words, NULL, NULL) + (end ? 1 : 0);
+
+    marked->text = (char*)malloc(strlen(text) + (size_t)count * MARK_COMMAND_MAX + 1);
+    marked->sources = (DECtalkMarkSource*)malloc((count ? count : 1) * sizeof(DECtalkMarkSource));
+    if (!marked->text || !marked->sources) {
+        return false;
+    }
+
+    marked->count = marked_text_scan(text, words, marked->text, marked->sources);
+    if (end) {
+        sprintf(marked->text + strlen(marked->text), "[:index mark %d]", marked->count + 1);
+        marked->sources[marked->count++] = (DECtalkMarkSource){ MARK_END, (int32_t)strlen(text), 0 };
+    }
+    return true;
+}
+
+static void marked_text_free(DECtalkMarkedText *marked) {
+    free(marked->text);
+    free(marked->sources);
+}
+
+// Run a request on engine, or on an idle pool engine if engine is NULL
+// Requests already in the audio cache are answered without touching an engine
+static int synthesize_engine_request(DECtalkEngine *engine, const DECtalkSettings *settings,
+                                     const char *text, DECtalkOutput *output) {
+    // Cached audio has no timeline
+    bool cacheable = output->timeline == NULL;
+    if (cacheable && cache_deliver(settings, text, output)) {
+        return DECtalkErrorNone;
+    }
+
+    bool dryRun = (output->options & DECtalkOptionDryRun) != 0;
+    DECtalkMarkedText marked = { NULL, NULL, 0 };
+    if (output->timeline && (dryRun || (output->options & (DECtalkOptionIndexMarks | DECtalkOptionWordMarks)))) {
+        if (!marked_text_build(&marked, text, (output->options & DECtalkOptionWordMarks) != 0, dryRun)) {
+            marked_text_free(&marked);
+            return DECtalkErrorBufferFull;
+        }
+        output->marked = &marked;
+    }
+
+    bool pooled = engine == NULL;
+    if (pooled) {
+        int result = g_initialized ? DECtalkErrorNone : dectalk_init();
+        if (result == DECtalkErrorNone) {
+            engine = pool_acquire();
+            if (!engine) {
+                result = DECtalkErrorSynthFailed;
+            }
+        }
+        if (result != DECtalkErrorNone) {
+            marked_text_free(&marked);
+            return result;
+        }
+    }
+
+    engine->output = output;
+    atomic_store(&engine->interrupted, false);
+    if (cacheable) {
+        cache_capture_begin(engine);
+    }
+
+    engine_apply_settings(engine, settings);
+    int result = DECtalkErrorNone;
+    if (!engine_output_stopped(engine)) {
+        result = engine_speak(engine, marked.text ? marked.text : text, settings->voice,
+                              dryRun ? WAVE_FORMAT_NULL : engine_wave_format(settings));
+    }
+    if (output->stopped && engine->inMemoryOpen) {
+        // Close in-memory mode to clear the buffers the reset left behind
+        TextToSpeechCloseInMemory(engine->ttsHandle);
+        engine->inMemoryOpen = false;
+    }
+
+    if (cacheable) {
+        cache_capture_end(engine, settings, text,
+                          result == DECtalkErrorNone && !atomic_load(&engine->interrupted));
+    }
+    engine->output = NULL;
+
+    if (pooled) {
+        pool_release(engine);
+    }
+
+    output->marked = NULL;
+    marked_text_free(&marked);
+    return result;
+}
+
+// Run a request, trimming the silence around its audio if the options ask for it
+// A dry run has no samples to trim
+static int synthesize_trimmed_request(DECtalkEngine *engine, const DECtalkSettings *settings,
+                                      const char *text, DECtalkOutput *output) {
+    if (!(output->options & DECtalkOptionTrimSilence) || (output->options & DECtalkOptionDryRun)) {
+        return synthesize_engine_request(engine, settings, text, output);
+    }
+
+    output->held = (int16_t*)malloc(TRIM_HOLD * sizeof(int16_t));
+    if (!output->held) {
+        return DECtalkErrorBufferFull;
+    }
+    output->trimPad = output->engineRate * TRIM_PAD_MS / 1000;
+
+    int result = synthesize_engine_request(engine, settings, text, output);
+    if (result == DECtalkErrorNone) {
+        trim_finish(output);
+    }
+
+    free(output->held);
+    output->held = NULL;
+    return result;
+}
+
+// Run a request with float output through a pipeline that lives as long as the request
+static int synthesize_float_request(DECtalkEngine *engine, const DECtalkSettings *settings,
+                                    const char *text, DECtalkOutput *output) {
+    output->pipeline = dectalk_float_pipeline_create(output->engineRate, output->sampleRate,
+                                                     output->gain, output->dcBlock);
+    if (!output->pipeline) {
+        return DECtalkErrorUnsupportedFormat;
+    }
+    int32_t capacity = dectalk_float_pipeline_max_output(output->pipeline, RESAMPLE_CHUNK);
+    output->floats = (float*)malloc((size_t)capacity * sizeof(float));
+
+    int result = output->floats ? synthesize_trimmed_request(engine, settings, text, output)
+                                : DECtalkErrorBufferFull;
+    if (result == DECtalkErrorNone) {
+        int32_t produced = dectalk_float_pipeline_flush(output->pipeline, output->floats);
+        if (produced > 0) {
+            output_deliver_float(output, output->floats, produced);
+        }
+    }
+
+    dectalk_float_pipeline_destroy(output->pipeline);
+    free(output->floats);
+    output->pipeline = NULL;
+    output->floats = NULL;
+    return result;
+}
+
+// Run a request, delivering its audio at the settings' output rate
+// The cache keeps the engine's samples, so cached audio is resampled on replay too
+static int synthesize_request(DECtalkEngine *engine, const DECtalkSettings *settings,
+                              const char *text, DECtalkOutput *output) {
+    // Timing-only requests count samples at the default rate whatever the format
+    bool dryRun = (output->options & DECtalkOptionDryRun) != 0;
+    output->engineRate = dryRun ? DECTALK_SAMPLE_RATE : engine_sample_rate(settings);
+    output->sampleRate = settings->outputRate;
+    if (output_is_float(output)) {
+        return synthesize_float_request(engine, settings, text, output);
+    }
+    if (dryRun || output->sampleRate == output->engineRate) {
+        return synthesize_trimmed_request(engine, settings, text, output);
+    }
+
+    output->resampler = dectalk_resampler_create(output->engineRate, settings->outputRate);
+    if (!output->resampler) {
+        return DECtalkErrorUnsupportedFormat;
+    }
+    int32_t capacity = dectalk_resampler_max_output(output->resampler, RESAMPLE_CHUNK);
+    output->resampled = (int16_t*)malloc((size_t)capacity * sizeof(int16_t));
+
+    int result = output->resampled ? synthesize_trimmed_request(engine, settings, text, output)
+                                   : DECtalkErrorBufferFull;
+    if (result == DECtalkErrorNone) {
+        // The end of the stream: the last samples the filter was holding back
+        int32_t produced = dectalk_resampler_flush(output->resampler, output->resampled);
+        if (produced > 0) {
+            output_deliver(output, output->resampled, produced);
+        }
+    }
+
+    dectalk_resampler_destroy(output->resampler);
+    free(output->resampled);
+    output->resampler = NULL;
+    output->resampled = NULL;
+    return result;
+}
+
+int dectalk_init(void) {
+    pthread_mutex_lock(&g_mutex);
+
+    if (g_initialized) {
+        pthread_mutex_unlock(&g_mutex);
+        return DECtalkErrorNone;
+    }
+
+    // Get the path to the dictionary file
+    load_dictionary_path_locked();
+
+    // Start the first engine up front so startup errors are reported here,
+    // the rest of the pool is started on demand
+    DECtalkEngine *engine = engine_register_locked(true);
+    if (!engine || engine_start(engine) != DECtalkErrorNone) {
+        if (engine) {
+            engine_unregister_locked(engine);
+        }
+        pthread_mutex_unlock(&g_mutex);
+        return DECtalkErrorInitFailed;
+    }
+
+    engine->ready = true;
+    engine->busy = false;
+    g_initialized = true;
+    pthread_mutex_lock(&g_settingsMutex);
+    g_settings.voice = DECtalkVoicePaul;
+    pthread_mutex_unlock(&g_settingsMutex);
+
+    fprintf(stderr, "DECtalk: Initialization successful!\n");
+
+    pthread_mutex_unlock(&g_mutex);
+    return DECtalkErrorNone;
+}
+
+void dectalk_shutdown(void) {
+    pthread_mutex_lock(&g_mutex);
+
+    // Let a warm-up in progress finish with its engines first
+    while (g_warming) {
+        pthread_cond_wait(&g_warmChanged, &g_mutex);
+    }
+    g_warm = false;
+
+    if (g_initialized) {
+        // Stop handing out engines and wait for in-flight requests to finish
+        g_initialized = false;
+        pthread_cond_broadcast(&g_engineAvailable);
+
+        // Context engines belong to their contexts and are left running
+        for (int slot = 0; slot < MAX_ENGINE_SLOTS; slot++) {
+            while (g_engines[slot] && g_engines[slot]->pooled && g_engines[slot]->busy) {
+                pthread_cond_wait(&g_engineAvailable, &g_mutex);
+            }
+            if (g_engines[slot] && g_engines[slot]->pooled) {
+                engine_stop(g_engines[slot]);
+                engine_unregister_locked(g_engines[slot]);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&g_mutex);
+}
+
+int dectalk_set_pool_size(int engines) {
+    if (engines < 1 || engines > DECTALK_MAX_ENGINES) {
+        return DECtalkErrorInitFailed;
+    }
+
+    pthread_mutex_lock(&g_mutex);
+    // Shrinking only limits new startups, running engines stay available
+    g_poolSize = engines;
+    pthread_cond_broadcast(&g_engineAvailable);
+    pthread_mutex_unlock(&g_mutex);
+
+    return DECtalkErrorNone;
+}
+
+int dectalk_get_pool_size(void) {
+    pthread_mutex_lock(&g_mutex);
+    int size = g_poolSize;
+    pthread_mutex_unlock(&g_mutex);
+    return size;
+}
+
+// The global settings as they are now, for one request
+static DECtalkSettings settings_snapshot(void) {
+    pthread_mutex_lock(&g_settingsMutex);
+    DECtalkSettings settings = g_settings;
+    pthread_mutex_unlock(&g_settingsMutex);
+    return settings;
+}
+
+int dectalk_set_voice(DECtalkVoice voice) {
+    if (voice < 0 || voice >= DECtalkVoiceCount) {
+        return DECtalkErrorInvalidVoice;
+    }
+    // Applied to the engine that handles the next request
+    pthread_mutex_lock(&g_settingsMutex);
+    g_settings.voice = voice;
+    pthread_mutex_unlock(&g_settingsMutex);
+
+    return DECtalkErrorNone;
+}
+
+DECtalkVoice dectalk_get_voice(void) {
+    pthread_mutex_lock(&g_settingsMutex);
+    DECtalkVoice voice = g_settings.voice;
+    pthread_mutex_unlock(&g_settingsMutex);
+    return voice;
+}
+
+int dectalk_synthesize(const char *text, int16_t *buffer, int32_t bufferSize, int32_t *samplesWritten) {
+    if (text == NULL || buffer == NULL || samplesWritten == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .buffer = buffer, .bufferSize = bufferSize };
+    DECtalkSettings settings = settings_snapshot();
+
+    int result = synthesize_request(NULL, &settings, text, &output);
+    *samplesWritten = output.samplesWritten;
+    return result;
+}
+
+// Stream text through an idle pool engine using the given settings
+// Each buffer is passed to the callback as soon as the engine fills it
+static int pool_synthesize(const DECtalkSettings *settings, const char *text,
+                           DECtalkAudioCallback callback, void *userData) {
+    DECtalkOutput output = { .callback = callback, .userData = userData };
+    return synthesize_request(NULL, settings, text, &output);
+}
+
+int dectalk_synthesize_with_callback(const char *text, DECtalkAudioCallback callback, void *userData) {
+    if (text == NULL || !callback) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkSettings settings = settings_snapshot();
+    return pool_synthesize(&settings, text, callback, userData);
+}
+
+int dectalk_synthesize_float(const char *text, float gain, bool dcBlock,
+                             float *buffer, int32_t bufferSize, int32_t *samplesWritten) {
+    if (text == NULL || buffer == NULL || samplesWritten == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .floatBuffer = buffer, .bufferSize = bufferSize, .gain = gain, .dcBlock = dcBlock };
+    DECtalkSettings settings = settings_snapshot();
+
+    int result = synthesize_request(NULL, &settings, text, &output);
+    *samplesWritten = output.samplesWritten;
+    return result;
+}
+
+int dectalk_synthesize_float_with_callback(const char *text, float gain, bool dcBlock,
+                                           DECtalkFloatCallback callback, void *userData) {
+    if (text == NULL || !callback) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .floatCallback = callback, .userData = userData, .gain = gain, .dcBlock = dcBlock };
+    DECtalkSettings settings = settings_snapshot();
+    return synthesize_request(NULL, &settings, text, &output);
+}
+
+#define G711_CHUNK 4096
+
+typedef struct {
+    DECtalkG711Law law;
+    DECtalkG711Callback callback;
+    void *userData;
+} DECtalkG711Output;
+
+// Encode each chunk of 8 kHz samples before passing it on
+static void g711_callback(int16_t *samples, int32_t count, void *userData) {
+    DECtalkG711Output *g711 = (DECtalkG711Output*)userData;
+    uint8_t encoded[G711_CHUNK];
+
+    while (count > 0) {
+        int32_t length = count < G711_CHUNK ? count : G711_CHUNK;
+        dectalk_encode_g711(samples, length, g711->law, encoded);
+        g711->callback(encoded, length, g711->userData);
+        samples += length;
+        count -= length;
+    }
+}
+
+// Run a request natively at 8 kHz on engine (NULL for the pool), delivering G.711
+static int g711_synthesize(DECtalkEngine *engine, const DECtalkSettings *settings, const char *text,
+                           DECtalkG711Law law, DECtalkG711Callback callback, void *userData) {
+    if (text == NULL || !callback || (law != DECtalkG711MuLaw && law != DECtalkG711ALaw)) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkSettings telephony = *settings;
+    telephony.outputRate = DECTALK_SAMPLE_RATE_8K;
+
+    DECtalkG711Output g711 = { law, callback, userData };
+    DECtalkOutput output = { .callback = g711_callback, .userData = &g711 };
+    return synthesize_request(engine, &telephony, text, &output);
+}
+
+int dectalk_synthesize_g711(const char *text, DECtalkG711Law law,
+                            DECtalkG711Callback callback, void *userData) {
+    DECtalkSettings settings = settings_snapshot();
+    return g711_synthesize(NULL, &settings, text, law, callback, userData);
+}
+
+// Move the timeline back by the samples trimmed from the start, keeping every
+// entry within the samples that remain
+static void audio_shift_timeline(dectalk_audio_t *audio, int32_t leading) {
+    for (int32_t i = 0; i < audio->markCount; i++) {
+        int32_t offset = audio->marks[i].sampleOffset - leading;
+        audio->marks[i].sampleOffset = offset < 0 ? 0 : offset > audio->sampleCount ? audio->sampleCount : offset;
+    }
+    for (int32_t i = 0; i < audio->phonemeCount; i++) {
+        int32_t offset = audio->phonemes[i].sampleOffset - leading;
+        audio->phonemes[i].sampleOffset = offset < 0 ? 0 : offset > audio->sampleCount ? audio->sampleCount : offset;
+    }
+}
+
+// Synthesize on engine (NULL for the pool) into a new result object
+static int audio_synthesize(DECtalkEngine *engine, const DECtalkSettings *settings,
+                            const char *text, uint32_t options, dectalk_audio_t **audio) {
+    if (text == NULL || audio == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+    *audio = NULL;
+
+    dectalk_audio_t *result = (dectalk_audio_t*)calloc(1, sizeof(dectalk_audio_t));
+    if (!result) {
+        return DECtalkErrorBufferFull;
+    }
+
+    DECtalkOutput output = { .callback = audio_append_callback, .userData = result, .options = options };
+    if (options & (DECtalkOptionNoAudio | DECtalkOptionDryRun)) {
+        output.callback = audio_count_callback;
+    }
+    if (options & (DECtalkOptionIndexMarks | DECtalkOptionWordMarks | DECtalkOptionPhonemes |
+                   DECtalkOptionNoAudio | DECtalkOptionDryRun)) {
+        output.timeline = result;
+    }
+
+    int status = synthesize_request(engine, settings, text, &output);
+
+    if (output.trimmedLeading > 0 || output.trimmedTrailing > 0) {
+        result->trimmedLeading = output_offset(&output, output.trimmedLeading);
+        result->trimmedTrailing = output_offset(&output, output.trimmedTrailing);
+        audio_shift_timeline(result, result->trimmedLeading);
+    }
+    // A dry run produces no samples, only the timing data's end of speech
+    result->speechEnd = (options & DECtalkOptionDryRun) ? output.speechEnd : result->sampleCount;
+    return audio_finish(result, status, audio);
+}
+
+int dectalk_synthesize_audio(const char *text, dectalk_audio_t **audio) {
+    return dectalk_synthesize_audio_ex(text, DECtalkOptionNone, audio);
+}
+
+int dectalk_synthesize_audio_ex(const char *text, uint32_t options, dectalk_audio_t **audio) {
+    DECtalkSettings settings = settings_snapshot();
+    return audio_synthesize(NULL, &settings, text, options, audio);
+}
+
+int32_t dectalk_audio_get_sample_count(const dectalk_audio_t *audio) {
+    return audio ? audio->sampleCount : 0;
+}
+
+int32_t dectalk_audio_get_chunk_count(const dectalk_audio_t *audio) {
+    return audio ? audio->chunkCount : 0;
+}
+
+const int16_t *dectalk_audio_get_chunk(const dectalk_audio_t *audio, int32_t index, int32_t *count) {
+    if (!audio || index < 0 || index >= audio->chunkCount) {
+        if (count) {
+            *count = 0;
+        }
+        return NULL;
+    }
+    if (count) {
+        *count = audio->chunks[index]->count;
+    }
+    return audio->chunks[index]->samples;
+}
+
+int32_t dectalk_audio_copy(const dectalk_audio_t *audio, int32_t offset, int16_t *buffer, int32_t count) {
+    if (!audio || !buffer || offset < 0 || count <= 0) {
+        return 0;
+    }
+
+    int32_t copied = 0;
+    for (int32_t i = 0; i < audio->chunkCount && copied < count; i++) {
+        const DECtalkAudioChunk *chunk = audio->chunks[i];
+        if (offset >= chunk->count) {
+            offset -= chunk->count;
+            continue;
+        }
+
+        int32_t n = chunk->count - offset;
+        if (n > count - copied) {
+            n = count - copied;
+        }
+        memcpy(buffer + copied, chunk->samples + offset, n * sizeof(int16_t));
+        copied += n;
+        offset = 0;
+    }
+    return copied;
+}
+
+int32_t dectalk_audio_get_index_mark_count(const dectalk_audio_t *audio) {
+    return audio ? audio->markCount : 0;
+}
+
+const DECtalkIndexMark *dectalk_audio_get_index_marks(const dectalk_audio_t *audio) {
+    return audio && audio->markCount > 0 ? audio->marks : NULL;
+}
+
+int32_t dectalk_audio_get_phoneme_count(const dectalk_audio_t *audio) {
+    return audio ? audio->phonemeCount : 0;
+}
+
+const DECtalkPhoneme *dectalk_audio_get_phonemes(const dectalk_audio_t *audio) {
+    return audio && audio->phonemeCount > 0 ? audio->phonemes : NULL;
+}
+
+int32_t dectalk_audio_get_speech_end(const dectalk_audio_t *audio) {
+    return audio ? audio->speechEnd : 0;
+}
+
+void dectalk_audio_get_trimmed(const dectalk_audio_t *audio, int32_t *leading, int32_t *trailing) {
+    if (leading) {
+        *leading = audio ? audio->trimmedLeading : 0;
+    }
+    if (trailing) {
+        *trailing = audio ? audio->trimmedTrailing : 0;
+    }
+}
+
+void dectalk_audio_free(dectalk_audio_t *audio) {
+    if (!audio) {
+        return;
+    }
+    for (int32_t i = 0; i < audio->chunkCount; i++) {
+        free(audio->chunks[i]);
+    }
+    free(audio->chunks);
+    free(audio->marks);
+    free(audio->phonemes);
+    free(audio);
+}
+
+int dectalk_extract_text_from_ssml(const char *ssml, char *plainText, int32_t maxLength) {
+    if (ssml == NULL || plainText == NULL || maxLength <= 0) {
+        return 0;
+    }
+
+    const char *src = ssml;
+    char *dst = plainText;
+    int32_t written = 0;
+    bool inTag = false;
+
+    while (*src && written < maxLength - 1) {
+        if (*src == '<') {
+            inTag = true;
+            src++;
+            continue;
+        }
+
+        if (*src == '>') {
+            inTag = false;
+            src++;
+            continue;
+        }
+
+        if (!inTag) {
+            // Handle HTML entities
+            if (*src == '&') {
+                if (strncmp(src, "&amp;", 5) == 0) {
+                    *dst++ = '&';
+                    written++;
+                    src += 5;
+                    continue;
+                } else if (strncmp(src, "&lt;", 4) == 0) {
+                    *dst++ = '<';
+                    written++;
+                    src += 4;
+                    continue;
+                } else if (strncmp(src, "&gt;", 4) == 0) {
+                    *dst++ = '>';
+                    written++;
+                    src += 4;
+                    continue;
+                } else if (strncmp(src, "&quot;", 6) == 0) {
+                    *dst++ = '"';
+                    written++;
+                    src += 6;
+                    continue;
+                } else if (strncmp(src, "&apos;", 6) == 0) {
+                    *dst++ = '\'';
                     written++;
                     src += 6;
                     continue;
@@ -409,91 +1718,2245 @@ int dectalk_extract_text_from_ssml(const char *ssml, char *plainText, int32_t ma
                 }
             }
 
-            *dst++ = *src;
-            written++;
+            *dst++ = *src;
+            written++;
+        }
+        src++;
+    }
+
+    *dst = '\0';
+    return written;
+}
+
+const char* dectalk_get_voice_name(DECtalkVoice voice) {
+    if (voice < 0 || voice >= DECtalkVoiceCount) {
+        return "Unknown";
+    }
+    return g_voiceNames[voice];
+}
+
+const char* dectalk_get_voice_command(DECtalkVoice voice) {
+    if (voice < 0 || voice >= DECtalkVoiceCount) {
+        return "[:np]";
+    }
+    return g_voiceCommands[voice];
+}
+
+// Check that audio can be delivered at sampleRate
+// This also builds the resampling filter, so the first request doesn't wait for it
+static bool output_rate_supported(int sampleRate) {
+    if (sampleRate < DECTALK_MIN_OUTPUT_RATE || sampleRate > DECTALK_MAX_OUTPUT_RATE) {
+        return false;
+    }
+    if (sampleRate == DECTALK_SAMPLE_RATE || sampleRate == DECTALK_SAMPLE_RATE_8K) {
+        return true;
+    }
+    dectalk_resampler_t *resampler = dectalk_resampler_create(DECTALK_SAMPLE_RATE, sampleRate);
+    dectalk_resampler_destroy(resampler);
+    return resampler != NULL;
+}
+
+int dectalk_set_output_rate(int sampleRate) {
+    if (!output_rate_supported(sampleRate)) {
+        return DECtalkErrorUnsupportedFormat;
+    }
+    // Applied to the next request
+    pthread_mutex_lock(&g_settingsMutex);
+    g_settings.outputRate = sampleRate;
+    pthread_mutex_unlock(&g_settingsMutex);
+    return DECtalkErrorNone;
+}
+
+int dectalk_get_sample_rate(void) {
+    pthread_mutex_lock(&g_settingsMutex);
+    int outputRate = g_settings.outputRate;
+    pthread_mutex_unlock(&g_settingsMutex);
+    return outputRate;
+}
+
+int dectalk_reset(void) {
+    int status = 0;
+
+    pthread_mutex_lock(&g_mutex);
+
+    for (int slot = 0; slot < MAX_ENGINE_SLOTS; slot++) {
+        DECtalkEngine *engine = g_engines[slot];
+        if (!engine || !engine->pooled || !engine->ready) {
+            continue;
+        }
+
+        // Reset the TTS engine - this clears any pending speech
+        MMRESULT result = TextToSpeechReset(engine->ttsHandle, FALSE);
+        if (result != MMSYSERR_NOERROR) {
+            status = -1;
+        }
+
+        // Close and reopen in-memory mode to clear buffers
+        // A busy engine is still owned by its request, so defer to release
+        atomic_store(&engine->interrupted, true);
+        if (engine->busy) {
+            engine->resetPending = true;
+        } else if (engine->inMemoryOpen) {
+            TextToSpeechCloseInMemory(engine->ttsHandle);
+            engine->inMemoryOpen = false;
+        }
+    }
+
+    pthread_mutex_unlock(&g_mutex);
+    return status;
+}
+
+int dectalk_sync(void) {
+    int status = 0;
+
+    pthread_mutex_lock(&g_mutex);
+
+    for (int slot = 0; slot < MAX_ENGINE_SLOTS; slot++) {
+        DECtalkEngine *engine = g_engines[slot];
+        if (engine && engine->pooled && engine->ready && TextToSpeechSync(engine->ttsHandle) != MMSYSERR_NOERROR) {
+            status = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&g_mutex);
+    return status;
+}
+
+static int clamp_rate(int wpm) {
+    // Clamp to valid range
+    if (wpm < 75) wpm = 75;
+    if (wpm > 600) wpm = 600;
+    return wpm;
+}
+
+static int clamp_volume(int volume) {
+    // DECtalk volume is 0-100
+    if (volume < 0) volume = 0;
+    if (volume > 100) volume = 100;
+    return volume;
+}
+
+int dectalk_set_rate(int wpm) {
+    // Applied to the engine that handles the next request
+    pthread_mutex_lock(&g_settingsMutex);
+    g_settings.rate = clamp_rate(wpm);
+    pthread_mutex_unlock(&g_settingsMutex);
+    return 0;
+}
+
+int dectalk_get_rate(void) {
+    pthread_mutex_lock(&g_settingsMutex);
+    int rate = g_settings.rate;
+    pthread_mutex_unlock(&g_settingsMutex);
+    return rate;
+}
+
+int dectalk_set_volume(int volume) {
+    // Applied to the engine that handles the next request
+    pthread_mutex_lock(&g_settingsMutex);
+    g_settings.volume = clamp_volume(volume);
+    pthread_mutex_unlock(&g_settingsMutex);
+    return 0;
+}
+
+int dectalk_get_volume(void) {
+    pthread_mutex_lock(&g_settingsMutex);
+    int volume = g_settings.volume;
+    pthread_mutex_unlock(&g_settingsMutex);
+    return volume;
+}
+
+const char* dectalk_get_version(void) {
+    return "DECtalk 5.0 (macOS)";
+}
+
+// MARK: - Synthesis contexts
+
+dectalk_context_t *dectalk_context_create(void) {
+    dectalk_context_t *ctx = (dectalk_context_t*)calloc(1, sizeof(dectalk_context_t));
+    if (!ctx) {
+        return NULL;
+    }
+
+    ctx->settings.voice = DECtalkVoicePaul;
+    ctx->settings.rate = DEFAULT_RATE;
+    ctx->settings.volume = -1;
+    ctx->settings.outputRate = DECTALK_SAMPLE_RATE;
+
+    pthread_mutex_lock(&g_mutex);
+    load_dictionary_path_locked();
+    ctx->engine = engine_register_locked(false);
+    pthread_mutex_unlock(&g_mutex);
+
+    if (!ctx->engine) {
+        fprintf(stderr, "DECtalk: No free engine slot for context\n");
+        free(ctx);
+        return NULL;
+    }
+
+    if (engine_start(ctx->engine) != DECtalkErrorNone) {
+        pthread_mutex_lock(&g_mutex);
+        engine_unregister_locked(ctx->engine);
+        pthread_mutex_unlock(&g_mutex);
+        free(ctx);
+        return NULL;
+    }
+
+    ctx->engine->ready = true;
+    return ctx;
+}
+
+void dectalk_context_destroy(dectalk_context_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    engine_stop(ctx->engine);
+    dectalk_context_disable_ring(ctx);
+
+    pthread_mutex_lock(&g_mutex);
+    engine_unregister_locked(ctx->engine);
+    pthread_mutex_unlock(&g_mutex);
+
+    free(ctx);
+}
+
+int dectalk_context_set_voice(dectalk_context_t *ctx, DECtalkVoice voice) {
+    if (!ctx || voice < 0 || voice >= DECtalkVoiceCount) {
+        return DECtalkErrorInvalidVoice;
+    }
+    ctx->settings.voice = voice;
+    return DECtalkErrorNone;
+}
+
+DECtalkVoice dectalk_context_get_voice(const dectalk_context_t *ctx) {
+    return ctx ? ctx->settings.voice : DECtalkVoicePaul;
+}
+
+int dectalk_context_set_rate(dectalk_context_t *ctx, int wpm) {
+    if (!ctx) {
+        return -1;
+    }
+    ctx->settings.rate = clamp_rate(wpm);
+    return 0;
+}
+
+int dectalk_context_get_rate(const dectalk_context_t *ctx) {
+    return ctx ? ctx->settings.rate : DEFAULT_RATE;
+}
+
+int dectalk_context_set_volume(dectalk_context_t *ctx, int volume) {
+    if (!ctx) {
+        return -1;
+    }
+    ctx->settings.volume = clamp_volume(volume);
+    return 0;
+}
+
+int dectalk_context_set_output_rate(dectalk_context_t *ctx, int sampleRate) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!output_rate_supported(sampleRate)) {
+        return DECtalkErrorUnsupportedFormat;
+    }
+    ctx->settings.outputRate = sampleRate;
+    return DECtalkErrorNone;
+}
+
+int dectalk_context_get_output_rate(const dectalk_context_t *ctx) {
+    return ctx ? ctx->settings.outputRate : DECTALK_SAMPLE_RATE;
+}
+
+int32_t dectalk_context_ssml_compile(const dectalk_context_t *ctx, const char *ssml, char *out, int32_t outSize,
+                                     char ***markNames, int32_t *markCount) {
+    if (!ctx) {
+        return -1;
+    }
+    return dectalk_ssml_compile_marks(ssml, ctx->settings.voice, ctx->settings.rate, ctx->settings.volume,
+                                      out, outSize, markNames, markCount);
+}
+
+int dectalk_context_synthesize(dectalk_context_t *ctx, const char *text,
+                               int16_t *buffer, int32_t bufferSize, int32_t *samplesWritten) {
+    if (ctx == NULL || text == NULL || buffer == NULL || samplesWritten == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .buffer = buffer, .bufferSize = bufferSize };
+
+    int result = synthesize_request(ctx->engine, &ctx->settings, text, &output);
+    *samplesWritten = output.samplesWritten;
+    return result;
+}
+
+int dectalk_context_synthesize_with_callback(dectalk_context_t *ctx, const char *text,
+                                             DECtalkAudioCallback callback, void *userData) {
+    if (ctx == NULL || text == NULL || !callback) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .callback = callback, .userData = userData };
+    return synthesize_request(ctx->engine, &ctx->settings, text, &output);
+}
+
+int dectalk_context_synthesize_float(dectalk_context_t *ctx, const char *text, float gain, bool dcBlock,
+                                     float *buffer, int32_t bufferSize, int32_t *samplesWritten) {
+    if (ctx == NULL || text == NULL || buffer == NULL || samplesWritten == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .floatBuffer = buffer, .bufferSize = bufferSize, .gain = gain, .dcBlock = dcBlock };
+
+    int result = synthesize_request(ctx->engine, &ctx->settings, text, &output);
+    *samplesWritten = output.samplesWritten;
+    return result;
+}
+
+int dectalk_context_synthesize_float_with_callback(dectalk_context_t *ctx, const char *text,
+                                                   float gain, bool dcBlock,
+                                                   DECtalkFloatCallback callback, void *userData) {
+    if (ctx == NULL || text == NULL || !callback) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkOutput output = { .floatCallback = callback, .userData = userData, .gain = gain, .dcBlock = dcBlock };
+    return synthesize_request(ctx->engine, &ctx->settings, text, &output);
+}
+
+int dectalk_context_synthesize_g711(dectalk_context_t *ctx, const char *text, DECtalkG711Law law,
+                                    DECtalkG711Callback callback, void *userData) {
+    if (ctx == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+    return g711_synthesize(ctx->engine, &ctx->settings, text, law, callback, userData);
+}
+
+int dectalk_context_synthesize_audio(dectalk_context_t *ctx, const char *text, dectalk_audio_t **audio) {
+    return dectalk_context_synthesize_audio_ex(ctx, text, DECtalkOptionNone, audio);
+}
+
+int dectalk_context_synthesize_audio_ex(dectalk_context_t *ctx, const char *text,
+                                        uint32_t options, dectalk_audio_t **audio) {
+    if (ctx == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+    return audio_synthesize(ctx->engine, &ctx->settings, text, options, audio);
+}
+
+int dectalk_context_reset(dectalk_context_t *ctx) {
+    if (!ctx) {
+        return -1;
+    }
+
+    DECtalkEngine *engine = ctx->engine;
+    atomic_store(&engine->interrupted, true);
+    MMRESULT result = TextToSpeechReset(engine->ttsHandle, FALSE);
+
+    if (engine->inMemoryOpen) {
+        TextToSpeechCloseInMemory(engine->ttsHandle);
+        engine->inMemoryOpen = false;
+    }
+
+    return result == MMSYSERR_NOERROR ? 0 : -1;
+}
+
+// MARK: - Ring buffer
+
+// How long the producer sleeps while waiting for the consumer to make room
+#define RING_WAIT_USEC 1000
+
+int dectalk_context_enable_ring(dectalk_context_t *ctx, int32_t capacity) {
+    if (!ctx || capacity <= 0 || capacity > (1 << 30)) {
+        return DECtalkErrorBufferFull;
+    }
+
+    // Round up to a power of two so indices can be masked
+    uint32_t size = 1;
+    while (size < (uint32_t)capacity) {
+        size <<= 1;
+    }
+
+    DECtalkRing *ring = (DECtalkRing*)calloc(1, sizeof(DECtalkRing));
+    int16_t *data = (int16_t*)malloc(size * sizeof(int16_t));
+    if (!ring || !data) {
+        free(ring);
+        free(data);
+        return DECtalkErrorBufferFull;
+    }
+
+    ring->data = data;
+    ring->capacity = size;
+    ring->mask = size - 1;
+    atomic_init(&ring->writeIndex, 0);
+    atomic_init(&ring->readIndex, 0);
+    atomic_init(&ring->discardIndex, 0);
+    atomic_init(&ring->producerDone, true);
+    atomic_init(&ring->state, RingIdle);
+
+    dectalk_context_disable_ring(ctx);
+    ctx->ring = ring;
+    return DECtalkErrorNone;
+}
+
+void dectalk_context_disable_ring(dectalk_context_t *ctx) {
+    if (ctx && ctx->ring) {
+        free(ctx->ring->data);
+        free(ctx->ring);
+        ctx->ring = NULL;
+    }
+}
+
+// Drop everything written so far; readers skip up to discardIndex, which only moves forward
+static void ring_discard(DECtalkRing *ring) {
+    uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_acquire);
+    uint32_t discard = atomic_load_explicit(&ring->discardIndex, memory_order_relaxed);
+    while ((int32_t)(write - discard) > 0 &&
+           !atomic_compare_exchange_weak_explicit(&ring->discardIndex, &discard, write,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+}
+
+static bool ring_cancelled(void *userData) {
+    DECtalkRing *ring = (DECtalkRing*)userData;
+    return atomic_load_explicit(&ring->state, memory_order_relaxed) == RingCancelled;
+}
+
+// Producer side, called with each chunk from the engine
+static void ring_push_callback(int16_t *samples, int32_t count, void *userData) {
+    DECtalkRing *ring = (DECtalkRing*)userData;
+
+    while (count > 0) {
+        if (ring_cancelled(ring)) {
+            return;
+        }
+
+        uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_relaxed);
+        uint32_t read = atomic_load_explicit(&ring->readIndex, memory_order_acquire);
+        uint32_t space = ring->capacity - (write - read);
+
+        if (space == 0) {
+            // Full - the consumer drains at playback speed, so wait for it
+            usleep(RING_WAIT_USEC);
+            continue;
+        }
+
+        uint32_t n = (uint32_t)count < space ? (uint32_t)count : space;
+        uint32_t start = write & ring->mask;
+        uint32_t first = ring->capacity - start;
+        if (first > n) {
+            first = n;
+        }
+
+        memcpy(ring->data + start, samples, first * sizeof(int16_t));
+        memcpy(ring->data, samples + first, (n - first) * sizeof(int16_t));
+
+        atomic_store_explicit(&ring->writeIndex, write + n, memory_order_release);
+        samples += n;
+        count -= (int32_t)n;
+    }
+}
+
+int dectalk_context_synthesize_to_ring(dectalk_context_t *ctx, const char *text) {
+    if (!ctx || !ctx->ring) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkRing *ring = ctx->ring;
+    if (text == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    // A cancel that arrived before the text started stops it here
+    int state = RingIdle;
+    if (!atomic_compare_exchange_strong(&ring->state, &state, RingActive)) {
+        if (state == RingArmed) {
+            atomic_store(&ring->state, RingIdle);
+            return DECtalkErrorNone;
+        }
+        return DECtalkErrorSynthFailed;     // Another producer is running
+    }
+    atomic_store(&ring->producerDone, false);
+
+    DECtalkOutput output = { .callback = ring_push_callback, .userData = ring,
+                             .stopRequested = ring_cancelled };
+    int result = synthesize_request(ctx->engine, &ctx->settings, text, &output);
+
+    // A cancel that raced with the last chunks drops them too
+    if (atomic_exchange(&ring->state, RingIdle) == RingCancelled) {
+        ring_discard(ring);
+        result = DECtalkErrorNone;
+    }
+    atomic_store_explicit(&ring->producerDone, true, memory_order_release);
+    return result;
+}
+
+void dectalk_ring_cancel(dectalk_context_t *ctx) {
+    if (!ctx || !ctx->ring) {
+        return;
+    }
+
+    DECtalkRing *ring = ctx->ring;
+    uint32_t read = atomic_load_explicit(&ring->readIndex, memory_order_relaxed);
+    uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_acquire);
+    bool unread = (int32_t)(write - read) > 0 &&
+                  (int32_t)(write - atomic_load_explicit(&ring->discardIndex, memory_order_relaxed)) > 0;
+    ring_discard(ring);
+
+    // Stop the text being synthesized; with none, arm the cancel for the next one
+    // unless there was audio still to play, which is what this cancel stopped
+    int state = atomic_load(&ring->state);
+    while (state == RingActive || (state == RingIdle && !unread)) {
+        int next = state == RingActive ? RingCancelled : RingArmed;
+        if (atomic_compare_exchange_weak(&ring->state, &state, next)) {
+            break;
+        }
+    }
+}
+
+// Consumer side: find the readable span without waiting, skipping cancelled samples
+static uint32_t ring_readable(DECtalkRing *ring, uint32_t *read) {
+    uint32_t write = atomic_load_explicit(&ring->writeIndex, memory_order_acquire);
+    uint32_t discard = atomic_load_explicit(&ring->discardIndex, memory_order_acquire);
+    *read = atomic_load_explicit(&ring->readIndex, memory_order_relaxed);
+    if ((int32_t)(discard - *read) > 0) {
+        *read = discard;
+    }
+    return write - *read;
+}
+
+int32_t dectalk_ring_read(dectalk_context_t *ctx, int16_t *samples, int32_t count) {
+    if (!ctx || !ctx->ring || !samples || count <= 0) {
+        return 0;
+    }
+
+    DECtalkRing *ring = ctx->ring;
+    uint32_t read;
+    uint32_t n = ring_readable(ring, &read);
+    if (n > (uint32_t)count) {
+        n = (uint32_t)count;
+    }
+
+    uint32_t start = read & ring->mask;
+    uint32_t first = ring->capacity - start;
+    if (first > n) {
+        first = n;
+    }
+
+    memcpy(samples, ring->data + start, first * sizeof(int16_t));
+    memcpy(samples + first, ring->data, (n - first) * sizeof(int16_t));
+
+    atomic_store_explicit(&ring->readIndex, read + n, memory_order_release);
+    return (int32_t)n;
+}
+
+int32_t dectalk_ring_read_float(dectalk_context_t *ctx, float *samples, int32_t count) {
+    if (!ctx || !ctx->ring || !samples || count <= 0) {
+        return 0;
+    }
+
+    DECtalkRing *ring = ctx->ring;
+    uint32_t read;
+    uint32_t n = ring_readable(ring, &read);
+    if (n > (uint32_t)count) {
+        n = (uint32_t)count;
+    }
+
+    // Convert to normalized float (-1.0 to 1.0) while copying out,
+    // in up to two runs when the readable samples wrap around the ring
+    uint32_t start = read & ring->mask;
+    uint32_t first = ring->mask + 1 - start;
+    if (first > n) {
+        first = n;
+    }
+    dectalk_convert_to_float(ring->data + start, samples, (int32_t)first);
+    dectalk_convert_to_float(ring->data, samples + first, (int32_t)(n - first));
+
+    atomic_store_explicit(&ring->readIndex, read + n, memory_order_release);
+    return (int32_t)n;
+}
+
+int32_t dectalk_ring_available(dectalk_context_t *ctx) {
+    if (!ctx || !ctx->ring) {
+        return 0;
+    }
+    uint32_t read;
+    return (int32_t)ring_readable(ctx->ring, &read);
+}
+
+bool dectalk_ring_finished(dectalk_context_t *ctx) {
+    if (!ctx || !ctx->ring) {
+        return true;
+    }
+    // Check done before emptiness so a final chunk is never missed
+    bool done = atomic_load_explicit(&ctx->ring->producerDone, memory_order_acquire);
+    return done && dectalk_ring_available(ctx) == 0;
+}
+
+// MARK: - Zero-copy output
+
+int dectalk_context_set_buffers(dectalk_context_t *ctx, int16_t *const *buffers,
+                                const int32_t *sizes, int32_t count) {
+    if (!ctx || count < 0 || count > MAX_CALLER_BUFFERS || (count > 0 && (!buffers || !sizes))) {
+        return DECtalkErrorBufferFull;
+    }
+
+    DECtalkEngine *engine = ctx->engine;
+    for (int32_t i = 0; i < engine->callerBufferCount; i++) {
+        if (atomic_load(&engine->callerBuffers[i].held)) {
+            // The caller still owns one of the old buffers
+            return DECtalkErrorBufferFull;
+        }
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        if (!buffers[i] || sizes[i] <= 0) {
+            return DECtalkErrorBufferFull;
+        }
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        DECtalkCallerBuffer *callerBuffer = &engine->callerBuffers[i];
+        memset(&callerBuffer->ttsBuffer, 0, sizeof(TTS_BUFFER_T));
+        callerBuffer->ttsBuffer.lpData = (LPSTR)buffers[i];
+        callerBuffer->ttsBuffer.dwMaximumBufferLength = (DWORD)sizes[i] * sizeof(int16_t);
+        atomic_store(&callerBuffer->held, false);
+    }
+    engine->callerBufferCount = count;
+
+    return DECtalkErrorNone;
+}
+
+int dectalk_context_synthesize_zero_copy(dectalk_context_t *ctx, const char *text,
+                                         DECtalkBufferCallback callback, void *userData) {
+    if (ctx == NULL || text == NULL || !callback || ctx->engine->callerBufferCount == 0) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    DECtalkEngine *engine = ctx->engine;
+    engine->bufferCallback = callback;
+    engine->bufferUserData = userData;
+
+    engine_apply_settings(engine, &ctx->settings);
+
+    int result = engine_speak(engine, text, ctx->settings.voice, WAVE_FORMAT_1M16);
+
+    engine->bufferCallback = NULL;
+    engine->bufferUserData = NULL;
+    return result;
+}
+
+int dectalk_context_return_buffer(dectalk_context_t *ctx, int16_t *samples) {
+    if (!ctx || !samples) {
+        return DECtalkErrorBufferFull;
+    }
+
+    DECtalkEngine *engine = ctx->engine;
+    for (int32_t i = 0; i < engine->callerBufferCount; i++) {
+        DECtalkCallerBuffer *callerBuffer = &engine->callerBuffers[i];
+        if ((int16_t*)callerBuffer->ttsBuffer.lpData != samples) {
+            continue;
+        }
+
+        // Take the state so a synthesis cannot start or end while the buffer changes hands
+        int state = atomic_load(&engine->callerBufferState);
+        while (state == CallerBuffersBusy ||
+               !atomic_compare_exchange_weak(&engine->callerBufferState, &state, CallerBuffersBusy)) {
+            state = atomic_load(&engine->callerBufferState);
+        }
+
+        bool expected = true;
+        bool returned = atomic_compare_exchange_strong(&callerBuffer->held, &expected, false);
+
+        // Give it straight back to the engine if a synthesis is running,
+        // otherwise it is queued with the others at the start of the next one
+        if (returned && state == CallerBuffersActive) {
+            callerBuffer->ttsBuffer.dwBufferLength = 0;
+            TextToSpeechAddBuffer(engine->ttsHandle, &callerBuffer->ttsBuffer);
+        }
+        atomic_store(&engine->callerBufferState, state);
+
+        // Not handed out, nothing to return
+        return returned ? DECtalkErrorNone : DECtalkErrorBufferFull;
+    }
+
+    return DECtalkErrorBufferFull;
+}
+
+// MARK: - Document synthesis
+
+// Segments longer than this are also split at clause boundaries
+#define DOCUMENT_MAX_SEGMENT 400
+
+// Pauses DECtalk makes after a sentence and after a comma at DEFAULT_RATE; they
+// shorten as the rate goes up. Segments are trimmed to their speech and joined
+// with the pause that matches the split.
+#define DOCUMENT_PERIOD_PAUSE_MS 640
+#define DOCUMENT_COMMA_PAUSE_MS 160
+
+// Inline commands that only act where they appear and must not be replayed
+// in front of later segments
+static const char *g_transientCommands[] = {
+    "pause", "tone", "index", "dial", "sync", "play", "note"
+};
+
+// Abbreviations whose period does not end a sentence
+static const char *g_abbreviations[] = {
+    "mr", "mrs", "ms", "dr", "st", "jr", "sr", "vs", "etc", "e.g", "i.e", "no", "inc", "ltd"
+};
+
+typedef struct {
+    const char *start;
+    size_t length;
+    size_t prefixLength;        // Bytes of carried-over commands in front of the segment
+    bool clause;                // Split at a clause boundary inside a long sentence
+    dectalk_audio_t *audio;     // Trimmed to the speech, trimmedLeading/Trailing say by how much
+    int result;
+} DECtalkSegment;
+
+typedef struct {
+    DECtalkSettings settings;
+    DECtalkSegment *segments;
+    int32_t segmentCount;
+    char *commands;             // All persistent inline commands in document order
+    _Atomic int32_t next;
+} DECtalkDocument;
+
+static bool is_transient_command(const char *cmd, size_t length) {
+    // cmd points past "[:"
+    for (size_t i = 0; i < sizeof(g_transientCommands) / sizeof(g_transientCommands[0]); i++) {
+        size_t n = strlen(g_transientCommands[i]);
+        if (length >= n && strncasecmp(cmd, g_transientCommands[i], n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Does the period at end close an abbreviation or a single initial rather than a sentence?
+static bool is_abbreviation(const char *segmentStart, const char *end) {
+    const char *word = end;
+    while (word > segmentStart && (isalpha((unsigned char)word[-1]) || word[-1] == '.')) {
+        word--;
+    }
+
+    size_t length = (size_t)(end - word);
+    if (length == 1 && isupper((unsigned char)*word)) {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(g_abbreviations) / sizeof(g_abbreviations[0]); i++) {
+        if (length == strlen(g_abbreviations[i]) && strncasecmp(word, g_abbreviations[i], length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Split text into sentence segments, collecting persistent inline commands as it goes
+// Each segment records how much of doc->commands precedes it
+static int document_split(DECtalkDocument *doc, const char *text) {
+    size_t textLen = strlen(text);
+    int32_t capacity = 16;
+    size_t commandsLength = 0;
+
+    doc->segments = (DECtalkSegment*)calloc(capacity, sizeof(DECtalkSegment));
+    doc->commands = (char*)malloc(textLen + 1);
+    if (!doc->segments || !doc->commands) {
+        return DECtalkErrorBufferFull;
+    }
+    doc->commands[0] = '\0';
+
+    const char *segmentStart = text;
+    size_t segmentPrefix = 0;
+    const char *p = text;
+
+    while (*p) {
+        bool boundary = false;
+        const char *end = p + 1;
+
+        // Keep closing quotes and brackets with their sentence
+        while (*end == '"' || *end == '\'' || *end == ')') {
+            end++;
+        }
+
+        if (*p == '[') {
+            // Never split inside inline commands or phonemic input
+            const char *close = strchr(p, ']');
+            if (!close) {
+                break;
+            }
+            if (p[1] == ':' && !is_transient_command(p + 2, (size_t)(close - p - 2))) {
+                size_t n = (size_t)(close - p + 1);
+                memcpy(doc->commands + commandsLength, p, n);
+                commandsLength += n;
+                doc->commands[commandsLength] = '\0';
+            }
+            p = close + 1;
+            continue;
+        }
+
+        if (*p == '\n') {
+            boundary = true;
+            end = p + 1;
+        } else if ((*p == '.' || *p == '!' || *p == '?') && (isspace((unsigned char)*end) || !*end)) {
+            boundary = *p != '.' || !is_abbreviation(segmentStart, p);
+        } else if ((*p == ';' || *p == ':' || *p == ',') && isspace((unsigned char)*end)) {
+            boundary = (size_t)(p - segmentStart) >= DOCUMENT_MAX_SEGMENT;
+        } else {
+            end = p + 1;
+        }
+
+        if (boundary) {
+            // Blank lines and other whitespace-only stretches are not worth a segment
+            const char *visible = segmentStart;
+            while (visible < end && isspace((unsigned char)*visible)) {
+                visible++;
+            }
+            if (visible == end) {
+                segmentStart = end;
+                segmentPrefix = commandsLength;
+                p = end;
+                continue;
+            }
+
+            if (doc->segmentCount == capacity) {
+                capacity *= 2;
+                DECtalkSegment *segments = (DECtalkSegment*)realloc(doc->segments, capacity * sizeof(DECtalkSegment));
+                if (!segments) {
+                    return DECtalkErrorBufferFull;
+                }
+                doc->segments = segments;
+            }
+
+            DECtalkSegment *segment = &doc->segments[doc->segmentCount++];
+            memset(segment, 0, sizeof(DECtalkSegment));
+            segment->start = segmentStart;
+            segment->length = (size_t)(end - segmentStart);
+            segment->prefixLength = segmentPrefix;
+            segment->clause = *p == ';' || *p == ':' || *p == ',';
+
+            segmentStart = end;
+            segmentPrefix = commandsLength;
+        }
+        p = end;
+    }
+
+    // Whatever follows the last boundary, unless it is only whitespace
+    const char *rest = segmentStart;
+    while (*rest && isspace((unsigned char)*rest)) {
+        rest++;
+    }
+    if (*rest) {
+        if (doc->segmentCount == capacity) {
+            DECtalkSegment *segments = (DECtalkSegment*)realloc(doc->segments, (capacity + 1) * sizeof(DECtalkSegment));
+            if (!segments) {
+                return DECtalkErrorBufferFull;
+            }
+            doc->segments = segments;
+        }
+        DECtalkSegment *segment = &doc->segments[doc->segmentCount++];
+        memset(segment, 0, sizeof(DECtalkSegment));
+        segment->start = segmentStart;
+        segment->length = strlen(segmentStart);
+        segment->prefixLength = segmentPrefix;
+    }
+
+    return DECtalkErrorNone;
+}
+
+static void document_synthesize_segment(DECtalkDocument *doc, DECtalkSegment *segment) {
+    segment->audio = (dectalk_audio_t*)calloc(1, sizeof(dectalk_audio_t));
+    char *text = (char*)malloc(segment->prefixLength + segment->length + 1);
+    if (!segment->audio || !text) {
+        free(text);
+        segment->result = DECtalkErrorBufferFull;
+        return;
+    }
+
+    // Replay earlier commands so the segment sounds as it would in a single pass
+    memcpy(text, doc->commands, segment->prefixLength);
+    memcpy(text + segment->prefixLength, segment->start, segment->length);
+    text[segment->prefixLength + segment->length] = '\0';
+
+    // Without the engine's start silence and end-of-utterance tail, so the seams
+    // get the pause the split calls for, see document_pause
+    DECtalkOutput output = { .callback = audio_append_callback, .userData = segment->audio,
+                             .options = DECtalkOptionTrimSilence };
+    segment->result = synthesize_request(NULL, &doc->settings, text, &output);
+    if (segment->result == DECtalkErrorNone && segment->audio->allocFailed) {
+        segment->result = DECtalkErrorBufferFull;
+    }
+    segment->audio->trimmedLeading = output_offset(&output, output.trimmedLeading);
+    segment->audio->trimmedTrailing = output_offset(&output, output.trimmedTrailing);
+    free(text);
+}
+
+// Samples of silence to put after segment, between its speech and the next one's
+// Each trimmed edge kept TRIM_PAD_MS of its silence, which counts towards the pause
+static int32_t document_pause(const DECtalkDocument *doc, const DECtalkSegment *segment) {
+    int pauseMs = segment->clause ? DOCUMENT_COMMA_PAUSE_MS : DOCUMENT_PERIOD_PAUSE_MS;
+    pauseMs = pauseMs * DEFAULT_RATE / doc->settings.rate - 2 * TRIM_PAD_MS;
+    return pauseMs > 0 ? (int32_t)((int64_t)pauseMs * doc->settings.outputRate / 1000) : 0;
+}
+
+static void *document_worker(void *arg) {
+    DECtalkDocument *doc = (DECtalkDocument*)arg;
+
+    for (;;) {
+        int32_t index = atomic_fetch_add(&doc->next, 1);
+        if (index >= doc->segmentCount) {
+            break;
+        }
+        document_synthesize_segment(doc, &doc->segments[index]);
+    }
+    return NULL;
+}
+
+static void audio_append_silence(dectalk_audio_t *audio, int32_t count) {
+    static const int16_t zeros[1024];
+    while (count > 0) {
+        int32_t n = count < 1024 ? count : 1024;
+        audio_append(audio, zeros, n);
+        count -= n;
+    }
+}
+
+// Move src's chunks to the end of dst without copying samples
+static int audio_concat(dectalk_audio_t *dst, dectalk_audio_t *src) {
+    if (dst->chunkCount + src->chunkCount > dst->chunkCapacity) {
+        int32_t newCapacity = dst->chunkCount + src->chunkCount + 8;
+        DECtalkAudioChunk **chunks = (DECtalkAudioChunk**)realloc(dst->chunks,
+                                                                  newCapacity * sizeof(DECtalkAudioChunk*));
+        if (!chunks) {
+            return DECtalkErrorBufferFull;
+        }
+        dst->chunks = chunks;
+        dst->chunkCapacity = newCapacity;
+    }
+
+    memcpy(dst->chunks + dst->chunkCount, src->chunks, src->chunkCount * sizeof(DECtalkAudioChunk*));
+    dst->chunkCount += src->chunkCount;
+    dst->sampleCount += src->sampleCount;
+    src->chunkCount = 0;
+    src->sampleCount = 0;
+    return DECtalkErrorNone;
+}
+
+int dectalk_synthesize_document(const char *text, dectalk_audio_t **audio) {
+    if (text == NULL || audio == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+    *audio = NULL;
+
+    if (!g_initialized) {
+        int result = dectalk_init();
+        if (result != DECtalkErrorNone) {
+            return result;
+        }
+    }
+
+    DECtalkDocument doc;
+    memset(&doc, 0, sizeof(doc));
+    doc.settings = settings_snapshot();
+    atomic_init(&doc.next, 0);
+
+    int result = document_split(&doc, text);
+
+    // One worker per pool engine, the calling thread being one of them
+    pthread_t threads[DECTALK_MAX_ENGINES];
+    int threadCount = 0;
+    if (result == DECtalkErrorNone) {
+        int workers = dectalk_get_pool_size();
+        if (workers > doc.segmentCount) {
+            workers = doc.segmentCount;
+        }
+        for (int i = 1; i < workers; i++) {
+            if (pthread_create(&threads[threadCount], NULL, document_worker, &doc) == 0) {
+                threadCount++;
+            }
+        }
+        document_worker(&doc);
+        for (int i = 0; i < threadCount; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // Stitch the segments back together in document order. The document starts
+    // and ends with as much silence as the engine gave it; being silence, it is
+    // put back as zeros.
+    dectalk_audio_t *output = (dectalk_audio_t*)calloc(1, sizeof(dectalk_audio_t));
+    if (!output && result == DECtalkErrorNone) {
+        result = DECtalkErrorBufferFull;
+    }
+    for (int32_t i = 0; i < doc.segmentCount; i++) {
+        DECtalkSegment *segment = &doc.segments[i];
+        if (result == DECtalkErrorNone) {
+            result = segment->result;
+        }
+        if (result == DECtalkErrorNone) {
+            if (i == 0) {
+                audio_append_silence(output, segment->audio->trimmedLeading);
+            }
+            result = audio_concat(output, segment->audio);
+            audio_append_silence(output, i + 1 < doc.segmentCount ? document_pause(&doc, segment)
+                                                                  : segment->audio->trimmedTrailing);
+            if (output->allocFailed) {
+                result = DECtalkErrorBufferFull;
+            }
+        }
+        dectalk_audio_free(segment->audio);
+    }
+
+    free(doc.segments);
+    free(doc.commands);
+
+    if (output) {
+        return audio_finish(output, result, audio);
+    }
+    return result;
+}
+
+// MARK: - Audio cache
+
+#define CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+#define CACHE_MIN_BUCKETS 64
+#define DISK_CACHE_MAX_SAMPLES (DECTALK_SAMPLE_RATE * 60)   // Longest utterance kept on disk
+
+typedef struct DECtalkCacheEntry {
+    struct DECtalkCacheEntry *hashNext;
+    struct DECtalkCacheEntry *prev;     // LRU list, most recently used first
+    struct DECtalkCacheEntry *next;
+    uint64_t hash;
+    DECtalkSettings settings;
+    char *text;                         // Normalized text
+    size_t textLength;
+    int16_t *samples;
+    int32_t sampleCount;
+    int32_t refCount;                   // Readers replaying the entry outside the lock
+    bool evicted;
+} DECtalkCacheEntry;
+
+static pthread_mutex_t g_cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static DECtalkCacheEntry **g_cacheBuckets = NULL;
+static size_t g_cacheBucketCount = 0;
+static DECtalkCacheEntry *g_cacheHead = NULL;
+static DECtalkCacheEntry *g_cacheTail = NULL;
+static int64_t g_cacheBudget = CACHE_DEFAULT_BUDGET;
+static int64_t g_cacheBytes = 0;
+static int32_t g_cacheEntries = 0;
+static int64_t g_cacheHits = 0;
+static int64_t g_cacheMisses = 0;
+static int64_t g_cacheEvictions = 0;
+static int64_t g_cacheDiskHits = 0;
+
+// Copy text without leading, trailing or repeated whitespace
+static char *cache_normalize(const char *text, size_t *length) {
+    char *normalized = (char*)malloc(strlen(text) + 1);
+    if (!normalized) {
+        return NULL;
+    }
+
+    size_t n = 0;
+    bool pendingSpace = false;
+    for (const char *p = text; *p; p++) {
+        if (isspace((unsigned char)*p)) {
+            pendingSpace = n > 0;
+            continue;
+        }
+        if (pendingSpace) {
+            normalized[n++] = ' ';
+            pendingSpace = false;
+        }
+        normalized[n++] = *p;
+    }
+    normalized[n] = '\0';
+
+    *length = n;
+    return normalized;
+}
+
+// FNV-1a over the normalized text and the settings
+static uint64_t cache_hash(const char *text, size_t length, const DECtalkSettings *settings) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)text[i]) * 1099511628211ULL;
+    }
+    int32_t fields[4] = { (int32_t)settings->voice, settings->rate, settings->volume,
+                          engine_sample_rate(settings) };
+    const uint8_t *bytes = (const uint8_t*)fields;
+    for (size_t i = 0; i < sizeof(fields); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int64_t cache_entry_bytes(const DECtalkCacheEntry *entry) {
+    return (int64_t)entry->sampleCount * (int64_t)sizeof(int16_t);
+}
+
+static void cache_entry_free(DECtalkCacheEntry *entry) {
+    free(entry->text);
+    free(entry->samples);
+    free(entry);
+}
+
+// Caller holds g_cacheMutex
+static DECtalkCacheEntry *cache_find_locked(uint64_t hash, const char *text, size_t length,
+                                            const DECtalkSettings *settings) {
+    if (g_cacheBucketCount == 0) {
+        return NULL;
+    }
+
+    DECtalkCacheEntry *entry = g_cacheBuckets[hash & (g_cacheBucketCount - 1)];
+    for (; entry; entry = entry->hashNext) {
+        if (entry->hash == hash &&
+            entry->textLength == length &&
+            entry->settings.voice == settings->voice &&
+            entry->settings.rate == settings->rate &&
+            entry->settings.volume == settings->volume &&
+            engine_sample_rate(&entry->settings) == engine_sample_rate(settings) &&
+            memcmp(entry->text, text, length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Caller holds g_cacheMutex
+static void cache_unlink_lru_locked(DECtalkCacheEntry *entry) {
+    if (entry->prev) entry->prev->next = entry->next; else g_cacheHead = entry->next;
+    if (entry->next) entry->next->prev = entry->prev; else g_cacheTail = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+// Caller holds g_cacheMutex
+static void cache_push_front_locked(DECtalkCacheEntry *entry) {
+    entry->prev = NULL;
+    entry->next = g_cacheHead;
+    if (g_cacheHead) g_cacheHead->prev = entry; else g_cacheTail = entry;
+    g_cacheHead = entry;
+}
+
+// Take an entry out of the cache, freeing it once no reader is replaying it
+// Caller holds g_cacheMutex
+static void cache_remove_locked(DECtalkCacheEntry *entry) {
+    DECtalkCacheEntry **link = &g_cacheBuckets[entry->hash & (g_cacheBucketCount - 1)];
+    while (*link != entry) {
+        link = &(*link)->hashNext;
+    }
+    *link = entry->hashNext;
+    cache_unlink_lru_locked(entry);
+
+    g_cacheBytes -= cache_entry_bytes(entry);
+    g_cacheEntries--;
+
+    entry->evicted = true;
+    if (entry->refCount == 0) {
+        cache_entry_free(entry);
+    }
+}
+
+// Evict least recently used entries until extra more bytes fit in the budget
+// Caller holds g_cacheMutex
+static void cache_trim_locked(int64_t extra) {
+    while (g_cacheTail && g_cacheBytes + extra > g_cacheBudget) {
+        cache_remove_locked(g_cacheTail);
+        g_cacheEvictions++;
+    }
+}
+
+// Double the bucket array once entries outnumber buckets
+// Caller holds g_cacheMutex
+static void cache_grow_locked(void) {
+    if (g_cacheBucketCount > 0 && (size_t)g_cacheEntries < g_cacheBucketCount) {
+        return;
+    }
+
+    size_t count = g_cacheBucketCount ? g_cacheBucketCount * 2 : CACHE_MIN_BUCKETS;
+    DECtalkCacheEntry **buckets = (DECtalkCacheEntry**)calloc(count, sizeof(DECtalkCacheEntry*));
+    if (!buckets) {
+        // Longer chains still work
+        return;
+    }
+
+    for (size_t i = 0; i < g_cacheBucketCount; i++) {
+        DECtalkCacheEntry *entry = g_cacheBuckets[i];
+        while (entry) {
+            DECtalkCacheEntry *next = entry->hashNext;
+            size_t bucket = entry->hash & (count - 1);
+            entry->hashNext = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(g_cacheBuckets);
+    g_cacheBuckets = buckets;
+    g_cacheBucketCount = count;
+}
+
+// Link an entry into the cache, replacing any entry with the same key
+// Returns false if it doesn't fit the budget; the caller still owns it then
+// Caller holds g_cacheMutex
+static bool cache_insert_locked(DECtalkCacheEntry *entry) {
+    int64_t bytes = cache_entry_bytes(entry);
+    if (g_cacheBudget <= 0 || bytes > g_cacheBudget / 4) {
+        return false;
+    }
+
+    // Another request may have stored the same utterance meanwhile
+    DECtalkCacheEntry *existing = cache_find_locked(entry->hash, entry->text, entry->textLength,
+                                                    &entry->settings);
+    if (existing) {
+        cache_remove_locked(existing);
+    }
+
+    cache_trim_locked(bytes);
+    cache_grow_locked();
+
+    size_t bucket = entry->hash & (g_cacheBucketCount - 1);
+    entry->hashNext = g_cacheBuckets[bucket];
+    g_cacheBuckets[bucket] = entry;
+    cache_push_front_locked(entry);
+    g_cacheBytes += bytes;
+    g_cacheEntries++;
+    return true;
+}
+
+static bool disk_cache_enabled(void);
+static bool disk_cache_writable(void);
+static DECtalkCacheEntry *disk_cache_load(uint64_t hash, const char *text, size_t length,
+                                          const DECtalkSettings *settings);
+static void disk_cache_append(const DECtalkCacheEntry *entry);
+static int32_t disk_cache_entry_count(void);
+
+// Replay a cached utterance into output, from memory or else from the disk cache
+// Returns false on a miss, in which case the request must be synthesized
+static bool cache_deliver(const DECtalkSettings *settings, const char *text, DECtalkOutput *output) {
+    pthread_mutex_lock(&g_cacheMutex);
+    bool enabled = g_cacheBudget > 0;
+    pthread_mutex_unlock(&g_cacheMutex);
+    if (!enabled && !disk_cache_enabled()) {
+        return false;
+    }
+
+    size_t length;
+    char *normalized = cache_normalize(text, &length);
+    if (!normalized) {
+        return false;
+    }
+    uint64_t hash = cache_hash(normalized, length, settings);
+
+    pthread_mutex_lock(&g_cacheMutex);
+    DECtalkCacheEntry *entry = cache_find_locked(hash, normalized, length, settings);
+    if (entry) {
+        g_cacheHits++;
+        entry->refCount++;
+        cache_unlink_lru_locked(entry);
+        cache_push_front_locked(entry);
+    }
+    pthread_mutex_unlock(&g_cacheMutex);
+
+    if (!entry) {
+        entry = disk_cache_load(hash, normalized, length, settings);
+
+        pthread_mutex_lock(&g_cacheMutex);
+        if (entry) {
+            // Keep it in memory too; if it doesn't fit it is freed after replay
+            g_cacheDiskHits++;
+            entry->refCount = 1;
+            entry->evicted = !cache_insert_locked(entry);
+        } else {
+            g_cacheMisses++;
+        }
+        pthread_mutex_unlock(&g_cacheMutex);
+    }
+    free(normalized);
+
+    if (!entry) {
+        return false;
+    }
+
+    // Replay in engine-sized buffers so streaming callers see the usual granularity,
+    // without holding the lock while the callback runs
+    const int32_t chunk = BUFFER_SIZE / sizeof(int16_t);
+    for (int32_t offset = 0; offset < entry->sampleCount; offset += chunk) {
+        int32_t count = entry->sampleCount - offset;
+        if (count > chunk) {
+            count = chunk;
+        }
+        output_write(output, entry->samples + offset, count);
+    }
+
+    pthread_mutex_lock(&g_cacheMutex);
+    entry->refCount--;
+    if (entry->evicted && entry->refCount == 0) {
+        cache_entry_free(entry);
+    }
+    pthread_mutex_unlock(&g_cacheMutex);
+    return true;
+}
+
+// Start keeping a copy of the engine's audio for the caches
+static void cache_capture_begin(DECtalkEngine *engine) {
+    pthread_mutex_lock(&g_cacheMutex);
+    engine->captureLimit = g_cacheBudget / 4 / (int64_t)sizeof(int16_t);
+    pthread_mutex_unlock(&g_cacheMutex);
+
+    if (disk_cache_writable() && engine->captureLimit < DISK_CACHE_MAX_SAMPLES) {
+        engine->captureLimit = DISK_CACHE_MAX_SAMPLES;
+    }
+    engine->capturing = engine->captureLimit > 0;
+    engine->captureCount = 0;
+}
+
+// Append audio to the engine's capture, giving up once it can no longer be cached
+static void engine_capture(DECtalkEngine *engine, const int16_t *samples, int32_t count) {
+    int64_t needed = (int64_t)engine->captureCount + count;
+    if (needed > engine->captureLimit) {
+        engine->capturing = false;
+        return;
+    }
+
+    if (needed > engine->captureCapacity) {
+        int32_t capacity = engine->captureCapacity ? engine->captureCapacity : AUDIO_FIRST_CHUNK;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        int16_t *grown = (int16_t*)realloc(engine->captureSamples, capacity * sizeof(int16_t));
+        if (!grown) {
+            engine->capturing = false;
+            return;
+        }
+        engine->captureSamples = grown;
+        engine->captureCapacity = capacity;
+    }
+
+    memcpy(engine->captureSamples + engine->captureCount, samples, count * sizeof(int16_t));
+    engine->captureCount += count;
+}
+
+// Store the engine's capture if the request completed and fit
+static void cache_capture_end(DECtalkEngine *engine, const DECtalkSettings *settings,
+                              const char *text, bool complete) {
+    bool capturing = engine->capturing;
+    engine->capturing = false;
+    if (!capturing || !complete) {
+        return;
+    }
+
+    DECtalkCacheEntry *entry = (DECtalkCacheEntry*)calloc(1, sizeof(DECtalkCacheEntry));
+    if (!entry) {
+        return;
+    }
+
+    entry->text = cache_normalize(text, &entry->textLength);
+    entry->samples = (int16_t*)malloc((engine->captureCount ? engine->captureCount : 1) * sizeof(int16_t));
+    if (!entry->text || !entry->samples) {
+        cache_entry_free(entry);
+        return;
+    }
+    memcpy(entry->samples, engine->captureSamples, engine->captureCount * sizeof(int16_t));
+    entry->sampleCount = engine->captureCount;
+    entry->settings = *settings;
+    entry->hash = cache_hash(entry->text, entry->textLength, settings);
+
+    disk_cache_append(entry);
+
+    pthread_mutex_lock(&g_cacheMutex);
+    bool stored = cache_insert_locked(entry);
+    pthread_mutex_unlock(&g_cacheMutex);
+
+    if (!stored) {
+        cache_entry_free(entry);
+    }
+}
+
+void dectalk_cache_set_budget(int64_t bytes) {
+    pthread_mutex_lock(&g_cacheMutex);
+    g_cacheBudget = bytes > 0 ? bytes : 0;
+    cache_trim_locked(0);
+    pthread_mutex_unlock(&g_cacheMutex);
+}
+
+void dectalk_cache_get_stats(DECtalkCacheStats *stats) {
+    if (!stats) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_cacheMutex);
+    stats->hits = g_cacheHits;
+    stats->misses = g_cacheMisses;
+    stats->evictions = g_cacheEvictions;
+    stats->bytes = g_cacheBytes;
+    stats->entries = g_cacheEntries;
+    stats->byteBudget = g_cacheBudget;
+    stats->diskHits = g_cacheDiskHits;
+    pthread_mutex_unlock(&g_cacheMutex);
+
+    stats->diskEntries = disk_cache_entry_count();
+}
+
+void dectalk_cache_clear(void) {
+    pthread_mutex_lock(&g_cacheMutex);
+    while (g_cacheHead) {
+        cache_remove_locked(g_cacheHead);
+    }
+    pthread_mutex_unlock(&g_cacheMutex);
+}
+
+// MARK: - Disk cache
+//
+// An append-only file of cached utterances. A header is followed by records,
+// each holding its key and samples; the index from key hash to record offset
+// is rebuilt by scanning the file when it is opened. Writers append whole
+// records under an exclusive flock, so several processes can share one file,
+// and readers pick up records appended by others the next time they miss.
+
+#define DISK_CACHE_MAGIC "DTKCACHE"
+#define DISK_CACHE_VERSION 2
+#define DISK_CACHE_RECORD_MAGIC 0x52544B44   // "DKTR"
+#define DISK_CACHE_MIN_SLOTS 256
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t sampleRate;
+    uint8_t reserved[48];
+} DECtalkDiskHeader;
+
+// Followed by textLength bytes of normalized text, padded to 8 bytes,
+// then sampleCount samples, padded to 8 bytes
+typedef struct {
+    uint32_t magic;
+    uint32_t textLength;
+    int32_t sampleCount;
+    int32_t voice;
+    int32_t rate;
+    int32_t volume;
+    int32_t sampleRate;         // Rate the engine ran at
+    uint32_t reserved;
+    uint64_t hash;
+} DECtalkDiskRecord;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;            // 0 marks an empty slot, records never start at 0
+} DECtalkDiskSlot;
+
+static pthread_mutex_t g_diskMutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_diskFd = -1;
+static bool g_diskReadOnly = false;
+static const uint8_t *g_diskMap = NULL;
+static size_t g_diskMapSize = 0;
+static size_t g_diskScanned = 0;   // End of the last valid record seen
+static DECtalkDiskSlot *g_diskSlots = NULL;
+static size_t g_diskSlotCount = 0;
+static int32_t g_diskEntries = 0;
+
+static size_t disk_align(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+static size_t disk_record_size(const DECtalkDiskRecord *record) {
+    return sizeof(DECtalkDiskRecord) +
+           disk_align(record->textLength) +
+           disk_align((size_t)record->sampleCount * sizeof(int16_t));
+}
+
+// Caller holds g_diskMutex
+static void disk_index_add_locked(uint64_t hash, uint64_t offset) {
+    if (g_diskSlotCount == 0 || (size_t)(g_diskEntries + 1) * 2 > g_diskSlotCount) {
+        size_t count = g_diskSlotCount ? g_diskSlotCount * 2 : DISK_CACHE_MIN_SLOTS;
+        DECtalkDiskSlot *slots = (DECtalkDiskSlot*)calloc(count, sizeof(DECtalkDiskSlot));
+        if (!slots) {
+            return;
+        }
+        for (size_t i = 0; i < g_diskSlotCount; i++) {
+            if (g_diskSlots[i].offset) {
+                size_t j = g_diskSlots[i].hash & (count - 1);
+                while (slots[j].offset) {
+                    j = (j + 1) & (count - 1);
+                }
+                slots[j] = g_diskSlots[i];
+            }
+        }
+        free(g_diskSlots);
+        g_diskSlots = slots;
+        g_diskSlotCount = count;
+    }
+
+    size_t i = hash & (g_diskSlotCount - 1);
+    while (g_diskSlots[i].offset) {
+        i = (i + 1) & (g_diskSlotCount - 1);
+    }
+    g_diskSlots[i].hash = hash;
+    g_diskSlots[i].offset = offset;
+    g_diskEntries++;
+}
+
+// Map the file as it is now and index any records appended since the last scan
+// Stops at the first incomplete record, which a writer may still be appending
+// Caller holds g_diskMutex
+static void disk_refresh_locked(void) {
+    struct stat st;
+    if (fstat(g_diskFd, &st) != 0 || (size_t)st.st_size <= g_diskMapSize) {
+        return;
+    }
+
+    if (g_diskMap) {
+        munmap((void*)g_diskMap, g_diskMapSize);
+        g_diskMap = NULL;
+        g_diskMapSize = 0;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, g_diskFd, 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    g_diskMap = (const uint8_t*)map;
+    g_diskMapSize = (size_t)st.st_size;
+
+    while (g_diskScanned + sizeof(DECtalkDiskRecord) <= g_diskMapSize) {
+        DECtalkDiskRecord record;
+        memcpy(&record, g_diskMap + g_diskScanned, sizeof(record));
+        if (record.magic != DISK_CACHE_RECORD_MAGIC ||
+            record.sampleCount < 0 || record.sampleCount > DISK_CACHE_MAX_SAMPLES ||
+            g_diskScanned + disk_record_size(&record) > g_diskMapSize) {
+            break;
         }
-        src++;
+        disk_index_add_locked(record.hash, g_diskScanned);
+        g_diskScanned += disk_record_size(&record);
     }
+}
 
-    *dst = '\0';
-    return written;
+// Cut the file back to the end of the last good record. With the exclusive
+// file lock held nobody is appending, so anything past it is a record torn by
+// a crash or a failed write, and new records must not land behind it.
+// Caller holds g_diskMutex and the exclusive file lock
+static void disk_truncate_torn_locked(void) {
+    struct stat st;
+    if (fstat(g_diskFd, &st) != 0 || (size_t)st.st_size <= g_diskScanned) {
+        return;
+    }
+
+    if (g_diskMap) {
+        munmap((void*)g_diskMap, g_diskMapSize);
+        g_diskMap = NULL;
+        g_diskMapSize = 0;
+    }
+    if (ftruncate(g_diskFd, (off_t)g_diskScanned) == 0) {
+        fprintf(stderr, "DECtalk: Dropped %lld bytes of a torn cache record\n",
+                (long long)st.st_size - (long long)g_diskScanned);
+    }
+    disk_refresh_locked();
 }
 
-const char* dectalk_get_voice_name(DECtalkVoice voice) {
-    if (voice < 0 || voice >= DECtalkVoiceCount) {
-        return "Unknown";
+// Find a record matching the key, returning its header or NULL
+// Caller holds g_diskMutex
+static const DECtalkDiskRecord *disk_find_locked(uint64_t hash, const char *text, size_t length,
+                                                 const DECtalkSettings *settings) {
+    if (g_diskSlotCount == 0) {
+        return NULL;
     }
-    return g_voiceNames[voice];
+
+    for (size_t i = hash & (g_diskSlotCount - 1); g_diskSlots[i].offset;
+         i = (i + 1) & (g_diskSlotCount - 1)) {
+        if (g_diskSlots[i].hash != hash) {
+            continue;
+        }
+        const DECtalkDiskRecord *record = (const DECtalkDiskRecord*)(g_diskMap + g_diskSlots[i].offset);
+        if (record->textLength == length &&
+            record->voice == (int32_t)settings->voice &&
+            record->rate == settings->rate &&
+            record->volume == settings->volume &&
+            record->sampleRate == engine_sample_rate(settings) &&
+            memcmp(record + 1, text, length) == 0) {
+            return record;
+        }
+    }
+    return NULL;
 }
 
-const char* dectalk_get_voice_command(DECtalkVoice voice) {
-    if (voice < 0 || voice >= DECtalkVoiceCount) {
-        return "[:np]";
+static bool disk_cache_enabled(void) {
+    pthread_mutex_lock(&g_diskMutex);
+    bool enabled = g_diskFd >= 0;
+    pthread_mutex_unlock(&g_diskMutex);
+    return enabled;
+}
+
+static bool disk_cache_writable(void) {
+    pthread_mutex_lock(&g_diskMutex);
+    bool writable = g_diskFd >= 0 && !g_diskReadOnly;
+    pthread_mutex_unlock(&g_diskMutex);
+    return writable;
+}
+
+static int32_t disk_cache_entry_count(void) {
+    pthread_mutex_lock(&g_diskMutex);
+    int32_t count = g_diskEntries;
+    pthread_mutex_unlock(&g_diskMutex);
+    return count;
+}
+
+// Copy a cached utterance out of the file into a new, unlinked cache entry
+static DECtalkCacheEntry *disk_cache_load(uint64_t hash, const char *text, size_t length,
+                                          const DECtalkSettings *settings) {
+    pthread_mutex_lock(&g_diskMutex);
+    if (g_diskFd < 0) {
+        pthread_mutex_unlock(&g_diskMutex);
+        return NULL;
     }
-    return g_voiceCommands[voice];
+
+    const DECtalkDiskRecord *record = disk_find_locked(hash, text, length, settings);
+    if (!record) {
+        // Another process may have appended it since
+        disk_refresh_locked();
+        record = disk_find_locked(hash, text, length, settings);
+    }
+
+    DECtalkCacheEntry *entry = NULL;
+    if (record) {
+        entry = (DECtalkCacheEntry*)calloc(1, sizeof(DECtalkCacheEntry));
+    }
+    if (entry) {
+        entry->text = (char*)malloc(length + 1);
+        entry->samples = (int16_t*)malloc((record->sampleCount ? record->sampleCount : 1) * sizeof(int16_t));
+        if (entry->text && entry->samples) {
+            memcpy(entry->text, text, length);
+            entry->text[length] = '\0';
+            entry->textLength = length;
+            entry->hash = hash;
+            entry->settings = *settings;
+            entry->sampleCount = record->sampleCount;
+            memcpy(entry->samples,
+                   (const uint8_t*)(record + 1) + disk_align(record->textLength),
+                   (size_t)record->sampleCount * sizeof(int16_t));
+        } else {
+            cache_entry_free(entry);
+            entry = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&g_diskMutex);
+    return entry;
 }
 
-int dectalk_get_sample_rate(void) {
-    return DECTALK_SAMPLE_RATE;
+// Append an utterance to the file unless it is already there
+static void disk_cache_append(const DECtalkCacheEntry *entry) {
+    if (entry->sampleCount > DISK_CACHE_MAX_SAMPLES) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_diskMutex);
+    if (g_diskFd < 0 || g_diskReadOnly) {
+        pthread_mutex_unlock(&g_diskMutex);
+        return;
+    }
+
+    DECtalkDiskRecord record = {
+        DISK_CACHE_RECORD_MAGIC,
+        (uint32_t)entry->textLength,
+        entry->sampleCount,
+        (int32_t)entry->settings.voice,
+        entry->settings.rate,
+        entry->settings.volume,
+        engine_sample_rate(&entry->settings),
+        0,
+        entry->hash
+    };
+    size_t size = disk_record_size(&record);
+    uint8_t *data = (uint8_t*)calloc(1, size);
+    if (!data) {
+        pthread_mutex_unlock(&g_diskMutex);
+        return;
+    }
+    memcpy(data, &record, sizeof(record));
+    memcpy(data + sizeof(record), entry->text, entry->textLength);
+    memcpy(data + sizeof(record) + disk_align(entry->textLength),
+           entry->samples, (size_t)entry->sampleCount * sizeof(int16_t));
+
+    // Holding the file lock, catch up with other writers and write the whole record at the end
+    flock(g_diskFd, LOCK_EX);
+    disk_refresh_locked();
+    disk_truncate_torn_locked();
+    if (!disk_find_locked(entry->hash, entry->text, entry->textLength, &entry->settings)) {
+        off_t offset = lseek(g_diskFd, 0, SEEK_END);
+        if (offset >= 0 && (size_t)offset == g_diskScanned) {
+            if (write(g_diskFd, data, size) == (ssize_t)size) {
+                disk_refresh_locked();
+            } else {
+                // A short write leaves a torn record of our own
+                disk_truncate_torn_locked();
+            }
+        }
+    }
+    flock(g_diskFd, LOCK_UN);
+
+    pthread_mutex_unlock(&g_diskMutex);
+    free(data);
 }
 
-int dectalk_reset(void) {
-    if (g_initialized && g_ttsHandle) {
-        // Reset the TTS engine - this clears any pending speech
-        MMRESULT result = TextToSpeechReset(g_ttsHandle, FALSE);
+// Caller holds g_diskMutex
+static void disk_close_locked(void) {
+    if (g_diskMap) {
+        munmap((void*)g_diskMap, g_diskMapSize);
+    }
+    if (g_diskFd >= 0) {
+        close(g_diskFd);
+    }
+    free(g_diskSlots);
+
+    g_diskFd = -1;
+    g_diskMap = NULL;
+    g_diskMapSize = 0;
+    g_diskScanned = 0;
+    g_diskSlots = NULL;
+    g_diskSlotCount = 0;
+    g_diskEntries = 0;
+}
 
-        // Close and reopen in-memory mode to clear buffers
-        if (g_inMemoryOpen) {
-            TextToSpeechCloseInMemory(g_ttsHandle);
-            g_inMemoryOpen = false;
+int dectalk_disk_cache_open(const char *path, bool readOnly) {
+    if (path == NULL) {
+        return DECtalkErrorIOFailed;
+    }
+
+    pthread_mutex_lock(&g_diskMutex);
+    disk_close_locked();
+
+    int fd = open(path, readOnly ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+    if (fd < 0) {
+        fprintf(stderr, "DECtalk: Cannot open cache file %s\n", path);
+        pthread_mutex_unlock(&g_diskMutex);
+        return DECtalkErrorIOFailed;
+    }
+
+    DECtalkDiskHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISK_CACHE_MAGIC, sizeof(header.magic));
+    header.version = DISK_CACHE_VERSION;
+    header.sampleRate = DECTALK_SAMPLE_RATE;
+
+    flock(fd, readOnly ? LOCK_SH : LOCK_EX);
+
+    // A new or empty file gets a header; an existing one must match ours
+    DECtalkDiskHeader existing;
+    ssize_t got = pread(fd, &existing, sizeof(existing), 0);
+    bool valid = got == (ssize_t)sizeof(existing) && memcmp(&existing, &header, 16) == 0;
+    if (!valid && !readOnly && got == 0) {
+        valid = pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    }
+
+    if (!valid) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        fprintf(stderr, "DECtalk: %s is not a compatible cache file\n", path);
+        pthread_mutex_unlock(&g_diskMutex);
+        return DECtalkErrorIOFailed;
+    }
+
+    g_diskFd = fd;
+    g_diskReadOnly = readOnly;
+    g_diskScanned = sizeof(DECtalkDiskHeader);
+    disk_refresh_locked();
+
+    if (!readOnly) {
+        disk_truncate_torn_locked();
+    }
+
+    flock(fd, LOCK_UN);
+    pthread_mutex_unlock(&g_diskMutex);
+    return DECtalkErrorNone;
+}
+
+void dectalk_disk_cache_close(void) {
+    pthread_mutex_lock(&g_diskMutex);
+    disk_close_locked();
+    pthread_mutex_unlock(&g_diskMutex);
+}
+
+// MARK: - Warm-up
+
+// Short enough to be quick, long enough to run letter-to-sound and the vocal tract model
+#define WARM_UP_TEXT "Hello, 42."
+
+// Speak the priming utterance, discarding its audio
+static void warm_up_engine(DECtalkEngine *engine, DECtalkVoice voice) {
+    DECtalkSettings settings = settings_snapshot();
+    settings.voice = voice;
+
+    engine_apply_settings(engine, &settings);
+    engine_speak(engine, WARM_UP_TEXT, voice, engine_wave_format(&settings));
+}
+
+static void *warm_up_worker(void *arg) {
+    (void)arg;
+
+    int result = dectalk_init();
+
+    if (result == DECtalkErrorNone) {
+        // Hold every engine the pool may use at once so each one gets started,
+        // has in-memory mode open and has spoken once
+        DECtalkEngine *engines[DECTALK_MAX_ENGINES];
+        int count = dectalk_get_pool_size();
+        int acquired = 0;
+        while (acquired < count && (engines[acquired] = pool_acquire()) != NULL) {
+            acquired++;
+        }
+        if (acquired < count) {
+            result = DECtalkErrorInitFailed;
         }
 
-        return result == MMSYSERR_NOERROR ? 0 : -1;
+        // Code and voice tables are shared, so one engine touching every voice faults them all in
+        for (int i = 0; i < acquired; i++) {
+            if (i == 0) {
+                for (int voice = 0; voice < DECtalkVoiceCount; voice++) {
+                    warm_up_engine(engines[i], (DECtalkVoice)voice);
+                }
+            } else {
+                warm_up_engine(engines[i], dectalk_get_voice());
+            }
+            pool_release(engines[i]);
+        }
     }
-    return 0;
+
+    pthread_mutex_lock(&g_mutex);
+    g_warmResult = result;
+    g_warm = result == DECtalkErrorNone;
+    g_warming = false;
+    pthread_cond_broadcast(&g_warmChanged);
+    pthread_mutex_unlock(&g_mutex);
+    return NULL;
 }
 
-int dectalk_sync(void) {
-    if (g_initialized && g_ttsHandle) {
-        return TextToSpeechSync(g_ttsHandle) == MMSYSERR_NOERROR ? 0 : -1;
+int dectalk_warm_up(void) {
+    pthread_mutex_lock(&g_mutex);
+
+    if (g_warming || g_warm) {
+        pthread_mutex_unlock(&g_mutex);
+        return DECtalkErrorNone;
     }
-    return 0;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int created = pthread_create(&thread, &attr, warm_up_worker, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (created != 0) {
+        pthread_mutex_unlock(&g_mutex);
+        return DECtalkErrorInitFailed;
+    }
+
+    g_warming = true;
+    pthread_mutex_unlock(&g_mutex);
+    return DECtalkErrorNone;
 }
 
-int dectalk_set_rate(int wpm) {
-    if (g_initialized && g_ttsHandle) {
-        // Clamp to valid range
-        if (wpm < 75) wpm = 75;
-        if (wpm > 600) wpm = 600;
-        return TextToSpeechSetRate(g_ttsHandle, (DWORD)wpm) == MMSYSERR_NOERROR ? 0 : -1;
+bool dectalk_is_warm(void) {
+    pthread_mutex_lock(&g_mutex);
+    bool warm = g_warm;
+    pthread_mutex_unlock(&g_mutex);
+    return warm;
+}
+
+int dectalk_wait_warm(void) {
+    pthread_mutex_lock(&g_mutex);
+    while (g_warming) {
+        pthread_cond_wait(&g_warmChanged, &g_mutex);
     }
-    return -1;
+    int result = g_warm ? DECtalkErrorNone : g_warmResult;
+    pthread_mutex_unlock(&g_mutex);
+    return result;
 }
 
-int dectalk_get_rate(void) {
-    if (g_initialized && g_ttsHandle) {
-        DWORD rate = 0;
-        if (TextToSpeechGetRate(g_ttsHandle, &rate) == MMSYSERR_NOERROR) {
-            return (int)rate;
+// MARK: - Phonemization
+//
+// The engine writes the phonemes it chooses to a log file. Speaking into a
+// WAVE_FORMAT_NULL stream with that log open runs letter-to-sound and timing
+// but skips the vocal tract model, which is nearly all of the synthesis cost.
+// Each worker keeps one log and one stream open for all of its strings, and
+// takes what the log gained once the engine has synced on a string.
+
+typedef struct {
+    const char *const *texts;
+    char **phonemes;
+    int32_t count;
+    _Atomic int32_t next;       // Next string to claim
+    _Atomic int result;
+} DECtalkPhonemizeBatch;
+
+// Read what the log gained since the last call, with whitespace runs collapsed
+static char *phonemize_read_log(FILE *f) {
+    // Reading on past the end seen last time
+    clearerr(f);
+
+    size_t capacity = 256;
+    size_t n = 0;
+    char *out = (char*)malloc(capacity);
+    bool pendingSpace = false;
+    int c;
+    while (out && (c = fgetc(f)) != EOF) {
+        if (isspace(c)) {
+            pendingSpace = n > 0;
+            continue;
+        }
+        if (n + 3 > capacity) {
+            capacity *= 2;
+            char *grown = (char*)realloc(out, capacity);
+            if (!grown) {
+                free(out);
+                out = NULL;
+                break;
+            }
+            out = grown;
+        }
+        if (pendingSpace) {
+            out[n++] = ' ';
+            pendingSpace = false;
         }
+        out[n++] = (char)c;
     }
-    return 180; // Default rate
+
+    if (out) {
+        out[n] = '\0';
+    }
+    return out;
 }
 
-int dectalk_set_volume(int volume) {
-    if (g_initialized && g_ttsHandle) {
-        // Clamp to valid range
-        if (volume < 0) volume = 0;
-        if (volume > 100) volume = 100;
-        // DECtalk volume is 0-100
-        DWORD vol = (DWORD)volume;
-        // Set both left and right channels
-        vol = vol | (vol << 16);
-        return TextToSpeechSetVolume(g_ttsHandle, VOLUME_MAIN, vol) == MMSYSERR_NOERROR ? 0 : -1;
+static void *phonemize_worker(void *arg) {
+    DECtalkPhonemizeBatch *batch = (DECtalkPhonemizeBatch*)arg;
+
+    const char *tmpdir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/dectalk-phonemes-XXXXXX", tmpdir && *tmpdir ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    FILE *log = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!log) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(path);
+        }
+        atomic_store(&batch->result, DECtalkErrorIOFailed);
+        return NULL;
+    }
+
+    DECtalkEngine *engine = pool_acquire();
+    if (!engine) {
+        atomic_store(&batch->result, DECtalkErrorSynthFailed);
+        fclose(log);
+        unlink(path);
+        return NULL;
+    }
+
+    DECtalkSettings settings = settings_snapshot();
+    if (TextToSpeechOpenLogFile(engine->ttsHandle, path, LOG_PHONEMES) != MMSYSERR_NOERROR) {
+        atomic_store(&batch->result, DECtalkErrorIOFailed);
+    }
+
+    for (;;) {
+        int32_t index = atomic_fetch_add(&batch->next, 1);
+        if (index >= batch->count || atomic_load(&batch->result) != DECtalkErrorNone) {
+            break;
+        }
+
+        // Start every string from the same state, so inline commands in one
+        // don't carry into the next and the result doesn't depend on scheduling
+        TextToSpeechReset(engine->ttsHandle, FALSE);
+        engine_apply_settings(engine, &settings);
+
+        // engine_speak syncs, so the log then ends with this string's phonemes
+        int result = engine_speak(engine, batch->texts[index] ? batch->texts[index] : "",
+                                  settings.voice, WAVE_FORMAT_NULL);
+        if (result == DECtalkErrorNone) {
+            batch->phonemes[index] = phonemize_read_log(log);
+            if (!batch->phonemes[index]) {
+                result = DECtalkErrorBufferFull;
+            }
+        }
+        if (result != DECtalkErrorNone) {
+            atomic_store(&batch->result, result);
+        }
     }
-    return -1;
+
+    TextToSpeechCloseLogFile(engine->ttsHandle);
+    pool_release(engine);
+    fclose(log);
+    unlink(path);
+    return NULL;
 }
 
-const char* dectalk_get_version(void) {
-    return "DECtalk 5.0 (macOS)";
+int dectalk_phonemize(const char *const *texts, int32_t count, char ***phonemes) {
+    if (texts == NULL || count < 0 || phonemes == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+    *phonemes = NULL;
+
+    if (!g_initialized) {
+        int result = dectalk_init();
+        if (result != DECtalkErrorNone) {
+            return result;
+        }
+    }
+
+    DECtalkPhonemizeBatch batch;
+    batch.texts = texts;
+    batch.count = count;
+    batch.phonemes = (char**)calloc(count ? count : 1, sizeof(char*));
+    atomic_init(&batch.next, 0);
+    atomic_init(&batch.result, DECtalkErrorNone);
+    if (!batch.phonemes) {
+        return DECtalkErrorBufferFull;
+    }
+
+    // One worker per pool engine, the calling thread being one of them
+    pthread_t threads[DECTALK_MAX_ENGINES];
+    int threadCount = 0;
+    int workers = dectalk_get_pool_size();
+    if (workers > count) {
+        workers = count;
+    }
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[threadCount], NULL, phonemize_worker, &batch) == 0) {
+            threadCount++;
+        }
+    }
+    if (count > 0) {
+        phonemize_worker(&batch);
+    }
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int result = atomic_load(&batch.result);
+    if (result != DECtalkErrorNone) {
+        dectalk_phonemes_free(batch.phonemes, count);
+        return result;
+    }
+
+    *phonemes = batch.phonemes;
+    return DECtalkErrorNone;
+}
+
+void dectalk_phonemes_free(char **phonemes, int32_t count) {
+    if (!phonemes) {
+        return;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        free(phonemes[i]);
+    }
+    free(phonemes);
+}
+
+// MARK: - WAV files
+
+// RIFF header, a JUNK chunk that becomes ds64 for RF64, fmt and the data chunk header
+#define WAV_HEADER_SIZE 80
+#define WAV_DS64_SIZE 28
+#define WAV_BUFFER_SAMPLES 16384
+
+struct dectalk_wav_writer {
+    int fd;
+    int sampleRate;
+    int64_t sampleCount;
+    bool failed;
+    int32_t bufferCount;
+    uint8_t buffer[WAV_BUFFER_SAMPLES * sizeof(int16_t)];
+};
+
+// Little-endian fields, independent of the host's byte order
+static uint8_t *wav_put16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    return p + 2;
+}
+
+static uint8_t *wav_put32(uint8_t *p, uint32_t value) {
+    return wav_put16(wav_put16(p, (uint16_t)value), (uint16_t)(value >> 16));
+}
+
+static uint8_t *wav_put64(uint8_t *p, uint64_t value) {
+    return wav_put32(wav_put32(p, (uint32_t)value), (uint32_t)(value >> 32));
+}
+
+static uint8_t *wav_put_id(uint8_t *p, const char *id) {
+    memcpy(p, id, 4);
+    return p + 4;
+}
+
+// Header for sampleCount samples; RF64 once the RIFF size no longer fits 32 bits
+static void wav_header(uint8_t *header, int sampleRate, int64_t sampleCount) {
+    uint64_t dataSize = (uint64_t)sampleCount * sizeof(int16_t);
+    uint64_t riffSize = WAV_HEADER_SIZE - 8 + dataSize;
+    bool rf64 = riffSize > UINT32_MAX;
+
+    uint8_t *p = header;
+    p = wav_put_id(p, rf64 ? "RF64" : "RIFF");
+    p = wav_put32(p, rf64 ? UINT32_MAX : (uint32_t)riffSize);
+    p = wav_put_id(p, "WAVE");
+
+    p = wav_put_id(p, rf64 ? "ds64" : "JUNK");
+    p = wav_put32(p, WAV_DS64_SIZE);
+    memset(p, 0, WAV_DS64_SIZE);
+    if (rf64) {
+        wav_put32(wav_put64(wav_put64(wav_put64(p, riffSize), dataSize), (uint64_t)sampleCount), 0);
+    }
+    p += WAV_DS64_SIZE;
+
+    p = wav_put_id(p, "fmt ");
+    p = wav_put32(p, 16);
+    p = wav_put16(p, 1);                                    // PCM
+    p = wav_put16(p, 1);                                    // Mono
+    p = wav_put32(p, (uint32_t)sampleRate);
+    p = wav_put32(p, (uint32_t)sampleRate * sizeof(int16_t));
+    p = wav_put16(p, sizeof(int16_t));
+    p = wav_put16(p, 16);
+
+    p = wav_put_id(p, "data");
+    wav_put32(p, rf64 ? UINT32_MAX : (uint32_t)dataSize);
+}
+
+// Write all of data, retrying short writes and interrupted system calls
+static bool wav_write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+static void wav_flush(dectalk_wav_writer_t *writer) {
+    if (!writer->failed) {
+        writer->failed = !wav_write_all(writer->fd, writer->buffer, (size_t)writer->bufferCount * sizeof(int16_t));
+    }
+    writer->bufferCount = 0;
+}
+
+dectalk_wav_writer_t *dectalk_wav_writer_open(const char *path, int sampleRate) {
+    if (path == NULL || sampleRate <= 0) {
+        return NULL;
+    }
+
+    dectalk_wav_writer_t *writer = (dectalk_wav_writer_t*)calloc(1, sizeof(dectalk_wav_writer_t));
+    if (!writer) {
+        return NULL;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        fprintf(stderr, "DECtalk: Cannot create %s\n", path);
+        free(writer);
+        return NULL;
+    }
+    writer->sampleRate = sampleRate;
+
+    // Placeholder sizes until the file is closed
+    uint8_t header[WAV_HEADER_SIZE];
+    wav_header(header, sampleRate, 0);
+    if (!wav_write_all(writer->fd, header, sizeof(header))) {
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int dectalk_wav_writer_write(dectalk_wav_writer_t *writer, const int16_t *samples, int32_t count) {
+    if (!writer || (!samples && count > 0)) {
+        return DECtalkErrorIOFailed;
+    }
+
+    for (int32_t i = 0; i < count && !writer->failed; i++) {
+        wav_put16(writer->buffer + (size_t)writer->bufferCount * sizeof(int16_t), (uint16_t)samples[i]);
+        if (++writer->bufferCount == WAV_BUFFER_SAMPLES) {
+            wav_flush(writer);
+        }
+    }
+    if (!writer->failed && count > 0) {
+        writer->sampleCount += count;
+    }
+    return writer->failed ? DECtalkErrorIOFailed : DECtalkErrorNone;
+}
+
+int64_t dectalk_wav_writer_get_sample_count(const dectalk_wav_writer_t *writer) {
+    return writer ? writer->sampleCount : 0;
+}
+
+int dectalk_wav_writer_close(dectalk_wav_writer_t *writer) {
+    if (!writer) {
+        return DECtalkErrorIOFailed;
+    }
+
+    wav_flush(writer);
+    if (!writer->failed) {
+        uint8_t header[WAV_HEADER_SIZE];
+        wav_header(header, writer->sampleRate, writer->sampleCount);
+        ssize_t written;
+        do {
+            written = pwrite(writer->fd, header, sizeof(header), 0);
+        } while (written < 0 && errno == EINTR);
+        writer->failed = written != (ssize_t)sizeof(header);
+    }
+    if (close(writer->fd) != 0) {
+        writer->failed = true;
+    }
+
+    int result = writer->failed ? DECtalkErrorIOFailed : DECtalkErrorNone;
+    free(writer);
+    return result;
+}
+
+// A failed write sticks in the writer, and wav_failed then stops the request
+static void wav_callback(int16_t *samples, int32_t count, void *userData) {
+    (void)dectalk_wav_writer_write((dectalk_wav_writer_t*)userData, samples, count);
+}
+
+// Once the file can't be written there is no point synthesizing the rest
+static bool wav_failed(void *userData) {
+    return ((dectalk_wav_writer_t*)userData)->failed;
+}
+
+// Stream a request on engine (NULL for the pool) into a new WAV file
+static int file_synthesize(DECtalkEngine *engine, const DECtalkSettings *settings,
+                           const char *text, const char *path) {
+    if (text == NULL || path == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+
+    dectalk_wav_writer_t *writer = dectalk_wav_writer_open(path, settings->outputRate);
+    if (!writer) {
+        return DECtalkErrorIOFailed;
+    }
+
+    DECtalkOutput output = { .callback = wav_callback, .userData = writer, .stopRequested = wav_failed };
+    int result = synthesize_request(engine, settings, text, &output);
+
+    int closed = dectalk_wav_writer_close(writer);
+    if (result == DECtalkErrorNone) {
+        result = closed;
+    }
+    if (result != DECtalkErrorNone) {
+        unlink(path);
+    }
+    return result;
+}
+
+int dectalk_synthesize_to_file(const char *text, const char *path) {
+    DECtalkSettings settings = settings_snapshot();
+    return file_synthesize(NULL, &settings, text, path);
+}
+
+int dectalk_context_synthesize_to_file(dectalk_context_t *ctx, const char *text, const char *path) {
+    if (ctx == NULL) {
+        return DECtalkErrorSynthFailed;
+    }
+    return file_synthesize(ctx->engine, &ctx->settings, text, path);
 }
@@ -17,6 +17,13 @@ extern "C" {
 #define DECTALK_SAMPLE_RATE 11025
 #define DECTALK_SAMPLE_RATE_8K 8000
 
+// Output rates that can be requested, see dectalk_set_output_rate
+#define DECTALK_MIN_OUTPUT_RATE 8000
+#define DECTALK_MAX_OUTPUT_RATE 192000
+
+// Maximum number of concurrently running DECtalk engines
+#define DECTALK_MAX_ENGINES 16
+
 // Voice identifiers - Classic DECtalk voices
 typedef enum {
     DECtalkVoicePaul = 0,    // Default male voice
@@ -37,7 +44,9 @@ typedef enum {
     DECtalkErrorInitFailed = 1,
     DECtalkErrorSynthFailed = 2,
     DECtalkErrorInvalidVoice = 3,
-    DECtalkErrorBufferFull = 4
+    DECtalkErrorBufferFull = 4,
+    DECtalkErrorIOFailed = 5,
+    DECtalkErrorUnsupportedFormat = 6
 } DECtalkError;
 
 // Synthesis state
@@ -52,9 +61,32 @@ typedef struct {
 // Returns 0 on success, error code otherwise
 int dectalk_init(void);
 
+// Start the engine pool in the background and prime it
+// Runs dectalk_init, then starts every engine the pool may use, opens its output
+// and speaks a short utterance so the first real request runs as fast as later ones.
+// Returns immediately; 0 if warm-up is running or already done, error code otherwise
+int dectalk_warm_up(void);
+
+// True once warm-up has completed successfully
+bool dectalk_is_warm(void);
+
+// Wait for a warm-up in progress to finish
+// Returns 0 if the pool is warm, the warm-up error code otherwise
+int dectalk_wait_warm(void);
+
 // Shutdown the DECtalk engine
+// Waits for in-flight synthesis calls to finish, then stops every engine in the pool
 void dectalk_shutdown(void);
 
+// Set the number of engines in the synthesis pool (1 to DECTALK_MAX_ENGINES)
+// Each engine is independent, so up to this many dectalk_synthesize calls
+// run concurrently. Engines beyond the first are started on demand.
+// Returns 0 on success, error code otherwise
+int dectalk_set_pool_size(int engines);
+
+// Get the number of engines in the synthesis pool
+int dectalk_get_pool_size(void);
+
 // Set the current voice
 // Returns 0 on success, error code otherwise
 int dectalk_set_voice(DECtalkVoice voice);
@@ -63,6 +95,7 @@ int dectalk_set_voice(DECtalkVoice voice);
 DECtalkVoice dectalk_get_voice(void);
 
 // Synthesize text to audio buffer
+// Thread-safe; the request runs on an idle engine from the pool
 // text: Input text (supports DECtalk commands embedded)
 // buffer: Output buffer for 16-bit PCM audio samples
 // bufferSize: Size of buffer in samples
@@ -71,12 +104,151 @@ DECtalkVoice dectalk_get_voice(void);
 int dectalk_synthesize(const char *text, int16_t *buffer, int32_t bufferSize, int32_t *samplesWritten);
 
 // Synthesize text and call callback for each chunk of audio
+// Chunks are delivered as the engine fills its buffers, so the first audio
+// arrives before synthesis of the whole text has finished, and there is no
+// limit on the total length. The samples pointer is only valid during the call.
+// The callback runs on the synthesizing thread and must not call back into the bridge.
 // text: Input text
 // callback: Called for each chunk of audio data
 // userData: User data passed to callback
 typedef void (*DECtalkAudioCallback)(int16_t *samples, int32_t count, void *userData);
 int dectalk_synthesize_with_callback(const char *text, DECtalkAudioCallback callback, void *userData);
 
+// G.711 companding laws for telephony
+typedef enum {
+    DECtalkG711MuLaw = 0,   // North America and Japan
+    DECtalkG711ALaw = 1     // Europe and most other networks
+} DECtalkG711Law;
+
+// Synthesize text for telephony: the engine runs natively at 8 kHz whatever the
+// output rate, and each chunk is delivered G.711 encoded, one byte per sample.
+// Streams like dectalk_synthesize_with_callback; data is only valid during the call.
+// law: Companding law of the delivered bytes
+typedef void (*DECtalkG711Callback)(const uint8_t *data, int32_t count, void *userData);
+int dectalk_synthesize_g711(const char *text, DECtalkG711Law law,
+                            DECtalkG711Callback callback, void *userData);
+
+// Synthesize text straight to float samples in -1.0 to 1.0 at the output rate
+// Conversion, gain, DC removal and any resampling run in one pass per engine
+// buffer that writes into buffer, see dectalk_float_pipeline_create.
+// gain: Linear factor on top of the volume setting, 1.0 keeps the level
+// dcBlock: Remove DC offset with a 10 Hz high-pass
+// Other parameters and results as dectalk_synthesize
+int dectalk_synthesize_float(const char *text, float gain, bool dcBlock,
+                             float *buffer, int32_t bufferSize, int32_t *samplesWritten);
+
+// Synthesize text to float samples, streaming chunks to callback
+// Same behavior as dectalk_synthesize_with_callback and dectalk_synthesize_float
+typedef void (*DECtalkFloatCallback)(const float *samples, int32_t count, void *userData);
+int dectalk_synthesize_float_with_callback(const char *text, float gain, bool dcBlock,
+                                           DECtalkFloatCallback callback, void *userData);
+
+// Synthesized audio of any length, see dectalk_synthesize_audio
+typedef struct dectalk_audio dectalk_audio_t;
+
+// Synthesize text into a growable result owned by the bridge
+// Unlike dectalk_synthesize nothing is truncated and no buffer size has to be guessed.
+// audio: Output - the result, to be released with dectalk_audio_free
+// Returns 0 on success, error code otherwise (audio is then NULL)
+int dectalk_synthesize_audio(const char *text, dectalk_audio_t **audio);
+
+// Exact number of samples in the result
+int32_t dectalk_audio_get_sample_count(const dectalk_audio_t *audio);
+
+// Iterate the result without copying: samples are stored in consecutive chunks
+// Returns the samples of chunk index and stores its length in count, or NULL past the end
+int32_t dectalk_audio_get_chunk_count(const dectalk_audio_t *audio);
+const int16_t *dectalk_audio_get_chunk(const dectalk_audio_t *audio, int32_t index, int32_t *count);
+
+// Copy up to count samples starting at sample offset into buffer
+// Returns the number of samples copied
+int32_t dectalk_audio_copy(const dectalk_audio_t *audio, int32_t offset, int16_t *buffer, int32_t count);
+
+// Release a result
+void dectalk_audio_free(dectalk_audio_t *audio);
+
+// Options for the _ex synthesis calls
+typedef enum {
+    DECtalkOptionNone = 0,
+    DECtalkOptionIndexMarks = 1 << 0,   // Collect the [:index mark N] commands in the text
+    DECtalkOptionWordMarks = 1 << 1,    // Also mark the start of every word
+    DECtalkOptionPhonemes = 1 << 2,     // Collect the phoneme timeline
+    DECtalkOptionNoAudio = 1 << 3,      // Keep only the sample count and timelines, not the samples
+    DECtalkOptionDryRun = 1 << 4,       // Run the front end and timing only, no waveform at all
+    DECtalkOptionTrimSilence = 1 << 5   // Drop the silence before and after the speech
+} DECtalkSynthesisOption;
+
+// An index mark reached during synthesis
+typedef struct {
+    int32_t sampleOffset;   // Offset in the result's samples
+    int32_t value;          // N of an [:index mark N] command, -1 for a word mark
+    int32_t textOffset;     // Byte offset in the request text of the command or word
+    int32_t textLength;     // Byte length of the command or word
+} DECtalkIndexMark;
+
+// A phoneme spoken during synthesis
+typedef struct {
+    int32_t phoneme;        // Engine phoneme code
+    int32_t sampleOffset;   // Offset in the result's samples where it starts
+    int32_t durationMs;
+} DECtalkPhoneme;
+
+// Synthesize text into a growable result, with options
+// The timeline options make the result carry index marks and/or phonemes; such
+// requests are never served from the cache. With DECtalkOptionNoAudio the result
+// has no chunks, but its sample count is still the exact length of the audio;
+// use it to size buffers.
+// DECtalkOptionDryRun is much cheaper: the engine renders no waveform, so the
+// result has no samples and a sample count of 0. Its timelines and
+// dectalk_audio_get_speech_end give the timing of the speech, for planning ahead
+// of synthesis.
+// Returns 0 on success, error code otherwise (audio is then NULL)
+int dectalk_synthesize_audio_ex(const char *text, uint32_t options, dectalk_audio_t **audio);
+
+// Index mark timeline of a result, in the order the marks were reached
+int32_t dectalk_audio_get_index_mark_count(const dectalk_audio_t *audio);
+const DECtalkIndexMark *dectalk_audio_get_index_marks(const dectalk_audio_t *audio);
+
+// Phoneme timeline of a result, in the order spoken
+int32_t dectalk_audio_get_phoneme_count(const dectalk_audio_t *audio);
+const DECtalkPhoneme *dectalk_audio_get_phonemes(const dectalk_audio_t *audio);
+
+// Where speech ends, in samples at the output rate
+// For a DECtalkOptionDryRun result this comes from the timing data. It is speech
+// timing, not a buffer size: the silence the engine adds after the speech is not
+// included, so a full synthesis of the same text is longer. Other results
+// return their sample count.
+int32_t dectalk_audio_get_speech_end(const dectalk_audio_t *audio);
+
+// Samples DECtalkOptionTrimSilence removed from the start and end of a result
+// Trimming works on the stream as the engine produces it: leading silence is
+// dropped before any audio is kept, and a short run of trailing silence is held
+// back until speech resumes or the request ends. A few milliseconds around the
+// speech are kept so soft onsets and decays are not cut. The result's index
+// marks and phonemes are already shifted by leading, so they stay in step with
+// its samples; marks inside trimmed silence move to the nearest kept sample.
+void dectalk_audio_get_trimmed(const dectalk_audio_t *audio, int32_t *leading, int32_t *trailing);
+
+// Synthesize a long document using every engine in the pool
+// The text is split at sentence boundaries (and at clause boundaries inside very
+// long sentences). Segments are synthesized concurrently, trimmed to their speech and
+// stitched back in order with DECtalk's sentence pause between them, or its comma
+// pause at a clause split, scaled to the rate. Inline commands are carried over
+// into later segments. Speed-up scales with dectalk_set_pool_size.
+// Returns 0 on success, error code otherwise; release audio with dectalk_audio_free
+int dectalk_synthesize_document(const char *text, dectalk_audio_t **audio);
+
+// Convert strings to DECtalk phoneme notation without rendering any audio
+// Runs letter-to-sound only, spread over the engines of the pool, so it is suited
+// to large word lists. Inline commands in the strings are honored.
+// texts: count input strings
+// phonemes: Output - count phoneme strings, release with dectalk_phonemes_free
+// Returns 0 on success, error code otherwise (phonemes is then NULL)
+int dectalk_phonemize(const char *const *texts, int32_t count, char ***phonemes);
+
+// Release the result of dectalk_phonemize
+void dectalk_phonemes_free(char **phonemes, int32_t count);
+
 // Extract plain text from SSML
 // ssml: Input SSML string
 // plainText: Output buffer for plain text
@@ -84,13 +256,58 @@ int dectalk_synthesize_with_callback(const char *text, DECtalkAudioCallback call
 // Returns length of extracted text
 int dectalk_extract_text_from_ssml(const char *ssml, char *plainText, int32_t maxLength);
 
+// Compile SSML into DECtalk text with inline commands in a single pass
+// Prosody, break, emphasis, say-as and sub are turned into commands and text.
+// Prosody and emphasis nest: each element sets absolute rate, pitch and volume
+// values when it opens and restores the enclosing ones when it closes, so a
+// whole document can be spoken in one request. Outside of any element rate
+// and volume apply (full volume for -1, the engine default), and the base pitch
+// of voice; pass the settings the text will be spoken with. Other markup is dropped, and inline commands
+// whose '[' the system stripped are restored. Text is converted to the engine's
+// character set, see dectalk_text_to_engine_charset. Each <mark> becomes an
+// [:index mark N] command, N counting the marks of the document from 1.
+// out: Output buffer, may be NULL when outSize is 0
+// Returns the length of the compiled text (like snprintf, the output is cut off
+// if that is not less than outSize), -1 on invalid arguments
+int32_t dectalk_ssml_compile(const char *ssml, DECtalkVoice voice, int rate, int volume,
+                             char *out, int32_t outSize);
+
+// Compile SSML like dectalk_ssml_compile and also return the names of its marks
+// Synthesizing the output with DECtalkOptionIndexMarks reports mark N with value N,
+// its name is markNames[N - 1] and its sampleOffset is where the mark is reached.
+// markNames: Output - markCount names, release with dectalk_ssml_marks_free
+// Returns as dectalk_ssml_compile, -1 also when out of memory (markNames is then NULL)
+int32_t dectalk_ssml_compile_marks(const char *ssml, DECtalkVoice voice, int rate, int volume,
+                                   char *out, int32_t outSize, char ***markNames, int32_t *markCount);
+
+// Release the mark names of dectalk_ssml_compile_marks
+void dectalk_ssml_marks_free(char **markNames, int32_t count);
+
+// Convert UTF-8 text to the engine's 8-bit character set (ISO 8859-1)
+// Latin-1 characters are kept, typographic punctuation becomes ASCII, accented
+// letters without a Latin-1 form lose their accent, a few symbols are spelled
+// out and anything else the engine can't say (emoji, other scripts) becomes a
+// space. Bytes that aren't valid UTF-8 are taken as Latin-1 and kept.
+// dectalk_ssml_compile does the same for SSML content, including &#xHHHH; entities.
+// Returns the length of the converted text like dectalk_ssml_compile
+int32_t dectalk_text_to_engine_charset(const char *text, char *out, int32_t outSize);
+
 // Get voice name for display
 const char* dectalk_get_voice_name(DECtalkVoice voice);
 
 // Get voice command string (e.g., "[:np]" for Paul)
 const char* dectalk_get_voice_command(DECtalkVoice voice);
 
-// Get sample rate
+// Set the sample rate of synthesized audio (DECTALK_MIN_OUTPUT_RATE to DECTALK_MAX_OUTPUT_RATE)
+// At DECTALK_SAMPLE_RATE_8K the engine itself runs at 8 kHz. Otherwise it runs at
+// DECTALK_SAMPLE_RATE, and audio for other rates passes through a resampler that
+// carries its state from one engine buffer to the next, so chunk boundaries are
+// seamless. Sample offsets of index marks and phonemes are given at the output
+// rate. Zero-copy synthesis always runs at DECTALK_SAMPLE_RATE.
+// Returns 0 on success, error code otherwise
+int dectalk_set_output_rate(int sampleRate);
+
+// Get sample rate of synthesized audio
 int dectalk_get_sample_rate(void);
 
 // Reset the synthesis engine
@@ -108,9 +325,313 @@ int dectalk_get_rate(void);
 // Set volume (0-100)
 int dectalk_set_volume(int volume);
 
+// Get volume, -1 while the engine default is in use
+int dectalk_get_volume(void);
+
 // Get version string
 const char* dectalk_get_version(void);
 
+// MARK: - Audio conversion
+//
+// Vectorized kernels (AVX2, SSE2 or NEON, whichever the CPU has) for turning
+// engine output into the float samples audio frameworks expect.
+
+// Convert 16-bit samples to float samples in -1.0 to 1.0
+void dectalk_convert_to_float(const int16_t *samples, float *out, int32_t count);
+
+// Convert 16-bit samples to float and upsample them 2x (11025 -> 22050 Hz)
+// with a half-band FIR in one pass. Even output samples are the input samples,
+// so sample offset n of the input is offset 2n of the output.
+// out: Output buffer for 2 * count samples
+// Returns the number of samples written, 0 on invalid arguments
+int32_t dectalk_upsample_2x(const int16_t *samples, int32_t count, float *out);
+
+// Streaming sample rate converter
+// A polyphase windowed-sinc filter whose state carries over from one call to the
+// next, so converting a stream chunk by chunk gives the same samples as converting
+// it at once. Output sample n lies at input time n * inputRate / outputRate.
+typedef struct dectalk_resampler dectalk_resampler_t;
+
+// Create a converter between two rates
+// The reduced ratio may have at most 4096 output positions per input sample, which
+// covers the usual rates, and the output rate must be at least a quarter of the input.
+// Returns NULL if the rates are not supported or memory runs out
+dectalk_resampler_t *dectalk_resampler_create(int inputRate, int outputRate);
+
+// Free a converter
+void dectalk_resampler_destroy(dectalk_resampler_t *resampler);
+
+// Most samples converting count more input samples can produce, for sizing out
+int32_t dectalk_resampler_max_output(const dectalk_resampler_t *resampler, int32_t count);
+
+// Convert the next count samples of the stream
+// Output that depends on samples not seen yet is held back until they arrive.
+// Returns the number of samples written to out
+int32_t dectalk_resampler_process(dectalk_resampler_t *resampler, const int16_t *samples,
+                                  int32_t count, int16_t *out);
+
+// End the stream: write the output held back for the last samples and start over
+// out must have room for dectalk_resampler_max_output(resampler, 0) samples
+// Returns the number of samples written to out
+int32_t dectalk_resampler_flush(dectalk_resampler_t *resampler, int16_t *out);
+
+// Drop the stream without writing anything and start over
+void dectalk_resampler_reset(dectalk_resampler_t *resampler);
+
+// Streaming conversion of 16-bit samples to float output
+// Applies a gain, optionally removes DC offset with a 10 Hz high-pass and
+// optionally resamples, in one pass that writes straight into out. State carries
+// over between calls like the resampler's.
+typedef struct dectalk_float_pipeline dectalk_float_pipeline_t;
+
+// Create a pipeline; equal rates skip resampling
+// gain: Linear factor applied to the normalized samples, 1.0 keeps the level
+// Returns NULL if the rates are not supported or memory runs out
+dectalk_float_pipeline_t *dectalk_float_pipeline_create(int inputRate, int outputRate,
+                                                        float gain, bool dcBlock);
+
+// Free a pipeline
+void dectalk_float_pipeline_destroy(dectalk_float_pipeline_t *pipeline);
+
+// Most samples converting count more input samples can produce, for sizing out
+int32_t dectalk_float_pipeline_max_output(const dectalk_float_pipeline_t *pipeline, int32_t count);
+
+// Convert the next count samples of the stream
+// Returns the number of samples written to out
+int32_t dectalk_float_pipeline_process(dectalk_float_pipeline_t *pipeline, const int16_t *samples,
+                                       int32_t count, float *out);
+
+// End the stream: write the output held back by the resampler and start over
+// out must have room for dectalk_float_pipeline_max_output(pipeline, 0) samples
+// Returns the number of samples written to out
+int32_t dectalk_float_pipeline_flush(dectalk_float_pipeline_t *pipeline, float *out);
+
+// Index of the first sample whose magnitude exceeds threshold, -1 if there is none
+int32_t dectalk_find_first_sound(const int16_t *samples, int32_t count, int16_t threshold);
+
+// Index of the last sample whose magnitude exceeds threshold, -1 if there is none
+int32_t dectalk_find_last_sound(const int16_t *samples, int32_t count, int16_t threshold);
+
+// Encode 16-bit samples as 8-bit G.711 code words, one byte per sample
+// out: Output buffer for count bytes
+void dectalk_encode_g711(const int16_t *samples, int32_t count, DECtalkG711Law law, uint8_t *out);
+
+// MARK: - Synthesis contexts
+//
+// A context owns a dedicated DECtalk engine together with its own voice,
+// rate, volume, buffers and output state. Different contexts can synthesize
+// on different threads at the same time without sharing any lock.
+// A single context must not be used from two threads at once.
+
+typedef struct dectalk_context dectalk_context_t;
+
+// Create a context and start its engine
+// Returns NULL if the engine could not be started
+dectalk_context_t *dectalk_context_create(void);
+
+// Stop the context's engine and free the context
+void dectalk_context_destroy(dectalk_context_t *ctx);
+
+// Set/get the context's voice
+// Returns 0 on success, error code otherwise
+int dectalk_context_set_voice(dectalk_context_t *ctx, DECtalkVoice voice);
+DECtalkVoice dectalk_context_get_voice(const dectalk_context_t *ctx);
+
+// Set/get the context's speaking rate (words per minute, 75-600)
+int dectalk_context_set_rate(dectalk_context_t *ctx, int wpm);
+int dectalk_context_get_rate(const dectalk_context_t *ctx);
+
+// Set the context's volume (0-100)
+int dectalk_context_set_volume(dectalk_context_t *ctx, int volume);
+
+// Set/get the sample rate of the context's audio, see dectalk_set_output_rate
+int dectalk_context_set_output_rate(dectalk_context_t *ctx, int sampleRate);
+int dectalk_context_get_output_rate(const dectalk_context_t *ctx);
+
+// Compile SSML like dectalk_ssml_compile_marks for the context's voice, rate and volume
+// markNames and markCount may both be NULL
+int32_t dectalk_context_ssml_compile(const dectalk_context_t *ctx, const char *ssml, char *out, int32_t outSize,
+                                     char ***markNames, int32_t *markCount);
+
+// Synthesize text on the context's engine
+// Same parameters and results as dectalk_synthesize
+int dectalk_context_synthesize(dectalk_context_t *ctx, const char *text,
+                               int16_t *buffer, int32_t bufferSize, int32_t *samplesWritten);
+
+// Synthesize text on the context's engine, streaming chunks to callback
+// Same behavior as dectalk_synthesize_with_callback
+int dectalk_context_synthesize_with_callback(dectalk_context_t *ctx, const char *text,
+                                             DECtalkAudioCallback callback, void *userData);
+
+// Synthesize text on the context's engine to float samples
+// Same behavior as dectalk_synthesize_float
+int dectalk_context_synthesize_float(dectalk_context_t *ctx, const char *text, float gain, bool dcBlock,
+                                     float *buffer, int32_t bufferSize, int32_t *samplesWritten);
+
+// Synthesize text on the context's engine to float samples, streaming chunks to callback
+// Same behavior as dectalk_synthesize_float_with_callback
+int dectalk_context_synthesize_float_with_callback(dectalk_context_t *ctx, const char *text,
+                                                   float gain, bool dcBlock,
+                                                   DECtalkFloatCallback callback, void *userData);
+
+// Synthesize text on the context's engine as 8 kHz G.711
+// Same behavior as dectalk_synthesize_g711
+int dectalk_context_synthesize_g711(dectalk_context_t *ctx, const char *text, DECtalkG711Law law,
+                                    DECtalkG711Callback callback, void *userData);
+
+// Synthesize text on the context's engine into a growable result
+// Same behavior as dectalk_synthesize_audio
+int dectalk_context_synthesize_audio(dectalk_context_t *ctx, const char *text, dectalk_audio_t **audio);
+
+// Same behavior as dectalk_synthesize_audio_ex
+int dectalk_context_synthesize_audio_ex(dectalk_context_t *ctx, const char *text,
+                                        uint32_t options, dectalk_audio_t **audio);
+
+// Clear any pending speech on the context's engine
+int dectalk_context_reset(dectalk_context_t *ctx);
+
+// MARK: - Ring buffer
+//
+// A context can feed a lock-free single-producer/single-consumer ring.
+// One thread runs dectalk_context_synthesize_to_ring while a real-time
+// consumer drains it with dectalk_ring_read; the read side never blocks
+// or allocates. Enable/disable must not race with either side.
+
+// Attach a ring holding at least capacity samples (rounded up to a power of two)
+// Replaces any existing ring. Returns 0 on success, error code otherwise
+int dectalk_context_enable_ring(dectalk_context_t *ctx, int32_t capacity);
+
+// Detach and free the context's ring
+void dectalk_context_disable_ring(dectalk_context_t *ctx);
+
+// Synthesize text into the ring (producer side)
+// Blocks while the ring is full until the consumer makes room or the ring is cancelled
+// Returns 0 on success or once cancelled, error code otherwise
+int dectalk_context_synthesize_to_ring(dectalk_context_t *ctx, const char *text);
+
+// Cancel the current text: the engine stops synthesizing it, the producer returns
+// early and samples not read yet are dropped. Safe to call from any thread.
+// With no text being synthesized and nothing left to read, the cancel applies
+// to the next dectalk_context_synthesize_to_ring, so a producer that has been
+// dispatched but not started yet is stopped as well.
+void dectalk_ring_cancel(dectalk_context_t *ctx);
+
+// Read up to count samples (consumer side, wait-free)
+// Returns the number of samples read, 0 if the ring is currently empty
+int32_t dectalk_ring_read(dectalk_context_t *ctx, int16_t *samples, int32_t count);
+
+// Same as dectalk_ring_read, converting to float samples in -1.0 to 1.0
+int32_t dectalk_ring_read_float(dectalk_context_t *ctx, float *samples, int32_t count);
+
+// Number of samples ready to read
+int32_t dectalk_ring_available(dectalk_context_t *ctx);
+
+// True once the producer has finished and every sample has been read
+bool dectalk_ring_finished(dectalk_context_t *ctx);
+
+// MARK: - Zero-copy output
+//
+// The engine can render straight into memory owned by the caller. Each filled
+// region is handed to the callback with no intermediate copy; the caller either
+// lets it go back to the engine right away or keeps it and returns it later.
+
+// Called with a filled caller buffer, on the synthesizing thread
+// samples points into one of the registered regions
+// Return false to give the buffer back to the engine immediately, or true to keep it
+// and return it later with dectalk_context_return_buffer. The engine needs at least
+// one buffer to make progress, so keep no more than all but one at a time.
+typedef bool (*DECtalkBufferCallback)(int16_t *samples, int32_t count, void *userData);
+
+// Register caller memory as the engine's output buffers (up to 16 regions)
+// buffers/sizes: count regions and their sizes in samples, kept alive by the caller
+// Pass count 0 to unregister. Fails while a buffer is still held by the caller.
+// Returns 0 on success, error code otherwise
+int dectalk_context_set_buffers(dectalk_context_t *ctx, int16_t *const *buffers,
+                                const int32_t *sizes, int32_t count);
+
+// Synthesize text into the registered buffers, passing each one to callback as it fills
+// Returns 0 on success, error code otherwise
+int dectalk_context_synthesize_zero_copy(dectalk_context_t *ctx, const char *text,
+                                         DECtalkBufferCallback callback, void *userData);
+
+// Return a buffer kept by the callback so the engine can fill it again
+// May be called from any thread
+int dectalk_context_return_buffer(dectalk_context_t *ctx, int16_t *samples);
+
+// MARK: - Audio cache
+//
+// Finished utterances are kept in memory, keyed by their text and the voice,
+// rate and volume they were spoken with. Repeating a request replays the cached
+// samples without running an engine. Leading, trailing and repeated whitespace
+// is ignored when matching text. Zero-copy synthesis bypasses the cache.
+
+// Cache statistics
+typedef struct {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t bytes;          // Sample memory held by cached utterances
+    int32_t entries;
+    int64_t byteBudget;
+    int64_t diskHits;       // Memory misses answered from the disk cache
+    int32_t diskEntries;
+} DECtalkCacheStats;
+
+// Set the memory the cache may use, evicting least recently used utterances to fit
+// Utterances larger than a quarter of the budget are not cached. 0 disables the cache.
+// The default budget is 4 MB.
+void dectalk_cache_set_budget(int64_t bytes);
+
+// Get the cache statistics
+void dectalk_cache_get_stats(DECtalkCacheStats *stats);
+
+// Drop every cached utterance
+void dectalk_cache_clear(void);
+
+// Open a persistent cache file, creating it unless readOnly
+// Utterances missing from memory are looked up in the file, and with write access
+// every newly synthesized utterance (up to a minute long) is appended to it. The file
+// survives restarts and can be shared by several processes; read-only users see
+// records appended by writers. Replaces any cache file already open.
+// Returns 0 on success, error code otherwise
+int dectalk_disk_cache_open(const char *path, bool readOnly);
+
+// Close the cache file
+void dectalk_disk_cache_close(void);
+
+// MARK: - WAV files
+//
+// Audio streamed to a 16-bit mono WAV file as it is produced, through a fixed
+// size buffer, so memory use does not grow with the length of the text. The
+// header is completed when the file is closed. Files past the 4 GB limit of
+// RIFF are finished as RF64 (EBU Tech 3306), for which the header reserves room.
+
+typedef struct dectalk_wav_writer dectalk_wav_writer_t;
+
+// Create a WAV file for samples at sampleRate, replacing any file at path
+// Returns NULL if the file cannot be created
+dectalk_wav_writer_t *dectalk_wav_writer_open(const char *path, int sampleRate);
+
+// Append samples to the file
+// Returns 0 on success, DECtalkErrorIOFailed once any write has failed
+int dectalk_wav_writer_write(dectalk_wav_writer_t *writer, const int16_t *samples, int32_t count);
+
+// Number of samples appended so far
+int64_t dectalk_wav_writer_get_sample_count(const dectalk_wav_writer_t *writer);
+
+// Write out what is buffered, complete the header and close the file
+// Returns 0 on success, DECtalkErrorIOFailed if any write failed
+int dectalk_wav_writer_close(dectalk_wav_writer_t *writer);
+
+// Synthesize text into a WAV file at the output rate, streaming it to disk
+// A write error stops the synthesis, and a file that could not be completed is removed.
+// Returns 0 on success, error code otherwise
+int dectalk_synthesize_to_file(const char *text, const char *path);
+
+// Synthesize text on the context's engine into a WAV file
+// Same behavior as dectalk_synthesize_to_file
+int dectalk_context_synthesize_to_file(dectalk_context_t *ctx, const char *text, const char *path);
+
 #ifdef __cplusplus
 }
 #endif
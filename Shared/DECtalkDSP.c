@@ -0,0 +1,1062 @@
+/*
+ * DECtalkDSP.c
+ * Sample conversion and resampling for DECtalk output
+ */
+
+#include "DECtalkBridge.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#if defined(__SSE2__)
+#define DSP_SSE2 1
+#endif
+// Built for AVX2 as well, used when the CPU has it
+#if defined(__clang__) || defined(__GNUC__)
+#define DSP_AVX2 1
+#endif
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_NEON 1
+#endif
+
+// Taps on each side of an interpolated sample
+#define DSP_HALF_BAND_TAPS 16
+
+// Samples upsampled per block, sized so a block and its context stay in L1
+#define DSP_BLOCK 256
+
+static const float kSampleScale = 1.0f / 32768.0f;
+
+// Odd phase of a half-band low-pass for 2x upsampling, Kaiser windowed sinc (beta 8).
+// The even phase is the input itself. Flat to 0.001 dB up to 4 kHz and at least
+// 80 dB down above 6.5 kHz at 11025 -> 22050 Hz. Coefficient j weighs the input
+// samples j before and j + 1 after an interpolated sample.
+static const float g_halfBand[DSP_HALF_BAND_TAPS] = {
+     0.634319601f, -0.205336079f,  0.116153688f, -0.075887624f,
+     0.052322425f, -0.036723664f,  0.025743207f, -0.017800990f,
+     0.012024403f, -0.007862785f,  0.004928025f, -0.002923815f,
+     0.001613365f, -0.000804602f,  0.000343148f, -0.000108304f
+};
+
+// MARK: - Conversion kernels
+
+// scale is kSampleScale times any gain
+
+static void convert_scalar(const int16_t *samples, float *out, int32_t count, float scale) {
+    for (int32_t i = 0; i < count; i++) {
+        out[i] = (float)samples[i] * scale;
+    }
+}
+
+#if DSP_SSE2
+static void convert_sse2(const int16_t *samples, float *out, int32_t count, float gain) {
+    const __m128 scale = _mm_set1_ps(gain);
+    int32_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(samples + i));
+        // Sign extend by placing each sample in the high half and shifting back
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    convert_scalar(samples + i, out + i, count - i, gain);
+}
+#endif
+
+#if DSP_AVX2
+__attribute__((target("avx2")))
+static void convert_avx2(const int16_t *samples, float *out, int32_t count, float gain) {
+    const __m256 scale = _mm256_set1_ps(gain);
+    int32_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i low = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i)));
+        __m256i high = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i + 8)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(low), scale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), scale));
+    }
+    convert_scalar(samples + i, out + i, count - i, gain);
+}
+#endif
+
+#if DSP_NEON
+static void convert_neon(const int16_t *samples, float *out, int32_t count, float scale) {
+    int32_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(samples + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    }
+    convert_scalar(samples + i, out + i, count - i, scale);
+}
+#endif
+
+// MARK: - DC blocker kernels
+//
+// One-pole high-pass y[n] = x[n] - x[n-1] + pole * y[n-1], fused with the
+// conversion. The vector kernels resolve the recurrence four samples at a time:
+// two shifted multiply-adds give each lane the inputs before it in the vector,
+// and pole^1..pole^4 times the last output carries in the previous vector.
+
+// Corner frequency of the DC blocker
+#define DSP_DC_CUTOFF 10.0
+
+typedef struct {
+    float pole;
+    float powers[4];        // pole^1 to pole^4
+    float lastInput;
+    float lastOutput;
+} DSPDCBlocker;
+
+static void dc_block_scalar(DSPDCBlocker *dc, const int16_t *samples, float *out, int32_t count, float scale) {
+    float lastInput = dc->lastInput;
+    float lastOutput = dc->lastOutput;
+    for (int32_t i = 0; i < count; i++) {
+        float x = (float)samples[i] * scale;
+        lastOutput = x - lastInput + dc->pole * lastOutput;
+        lastInput = x;
+        out[i] = lastOutput;
+    }
+    dc->lastInput = lastInput;
+    dc->lastOutput = lastOutput;
+}
+
+#if DSP_SSE2
+static inline __m128 shift_lanes_sse2(__m128 v, int lanes) {
+    return lanes == 1 ? _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4))
+                      : _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8));
+}
+
+static void dc_block_sse2(DSPDCBlocker *dc, const int16_t *samples, float *out, int32_t count, float gain) {
+    const __m128 scale = _mm_set1_ps(gain);
+    const __m128 pole = _mm_set1_ps(dc->pole);
+    const __m128 pole2 = _mm_set1_ps(dc->powers[1]);
+    const __m128 carry = _mm_loadu_ps(dc->powers);
+    __m128 lastInput = _mm_set1_ps(dc->lastInput);
+    __m128 lastOutput = _mm_set1_ps(dc->lastOutput);
+    int32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadl_epi64((const __m128i *)(samples + i));
+        __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale);
+        __m128 y = _mm_sub_ps(x, _mm_move_ss(shift_lanes_sse2(x, 1), lastInput));
+        y = _mm_add_ps(y, _mm_mul_ps(pole, shift_lanes_sse2(y, 1)));
+        y = _mm_add_ps(y, _mm_mul_ps(pole2, shift_lanes_sse2(y, 2)));
+        y = _mm_add_ps(y, _mm_mul_ps(carry, lastOutput));
+        _mm_storeu_ps(out + i, y);
+        lastInput = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+        lastOutput = _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    dc->lastInput = _mm_cvtss_f32(lastInput);
+    dc->lastOutput = _mm_cvtss_f32(lastOutput);
+    dc_block_scalar(dc, samples + i, out + i, count - i, gain);
+}
+#endif
+
+#if DSP_NEON
+static void dc_block_neon(DSPDCBlocker *dc, const int16_t *samples, float *out, int32_t count, float scale) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t carry = vld1q_f32(dc->powers);
+    float32x4_t lastInput = vdupq_n_f32(dc->lastInput);
+    float32x4_t lastOutput = vdupq_n_f32(dc->lastOutput);
+    int32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(samples + i))), scale);
+        float32x4_t y = vsubq_f32(x, vextq_f32(lastInput, x, 3));
+        y = vmlaq_n_f32(y, vextq_f32(zero, y, 3), dc->pole);
+        y = vmlaq_n_f32(y, vextq_f32(zero, y, 2), dc->powers[1]);
+        y = vmlaq_f32(y, carry, lastOutput);
+        vst1q_f32(out + i, y);
+        lastInput = x;
+        lastOutput = vdupq_n_f32(vgetq_lane_f32(y, 3));
+    }
+    dc->lastInput = vgetq_lane_f32(lastInput, 3);
+    dc->lastOutput = vgetq_lane_f32(lastOutput, 0);
+    dc_block_scalar(dc, samples + i, out + i, count - i, scale);
+}
+#endif
+
+// MARK: - Half-band kernels
+//
+// center points at the first of count input samples, with DSP_HALF_BAND_TAPS - 1
+// samples of context before and DSP_HALF_BAND_TAPS after. Writes 2 * count samples.
+
+static void half_band_scalar(const float *center, int32_t count, float *out) {
+    for (int32_t i = 0; i < count; i++) {
+        float sum = 0.0f;
+        for (int32_t j = 0; j < DSP_HALF_BAND_TAPS; j++) {
+            sum += g_halfBand[j] * (center[i - j] + center[i + 1 + j]);
+        }
+        out[2 * i] = center[i];
+        out[2 * i + 1] = sum;
+    }
+}
+
+#if DSP_SSE2
+static void half_band_sse2(const float *center, int32_t count, float *out) {
+    int32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int32_t j = 0; j < DSP_HALF_BAND_TAPS; j++) {
+            __m128 pair = _mm_add_ps(_mm_loadu_ps(center + i - j), _mm_loadu_ps(center + i + 1 + j));
+            sum = _mm_add_ps(sum, _mm_mul_ps(pair, _mm_set1_ps(g_halfBand[j])));
+        }
+        __m128 even = _mm_loadu_ps(center + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(even, sum));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(even, sum));
+    }
+    half_band_scalar(center + i, count - i, out + 2 * i);
+}
+#endif
+
+#if DSP_AVX2
+__attribute__((target("avx2,fma")))
+static void half_band_avx2(const float *center, int32_t count, float *out) {
+    int32_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int32_t j = 0; j < DSP_HALF_BAND_TAPS; j++) {
+            __m256 pair = _mm256_add_ps(_mm256_loadu_ps(center + i - j), _mm256_loadu_ps(center + i + 1 + j));
+            sum = _mm256_fmadd_ps(pair, _mm256_set1_ps(g_halfBand[j]), sum);
+        }
+        // Interleaving works within 128-bit lanes, so put the lanes back in order
+        __m256 even = _mm256_loadu_ps(center + i);
+        __m256 low = _mm256_unpacklo_ps(even, sum);
+        __m256 high = _mm256_unpackhi_ps(even, sum);
+        _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(low, high, 0x31));
+    }
+    half_band_scalar(center + i, count - i, out + 2 * i);
+}
+#endif
+
+#if DSP_NEON
+static void half_band_neon(const float *center, int32_t count, float *out) {
+    int32_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (int32_t j = 0; j < DSP_HALF_BAND_TAPS; j++) {
+            float32x4_t pair = vaddq_f32(vld1q_f32(center + i - j), vld1q_f32(center + i + 1 + j));
+            sum = vmlaq_n_f32(sum, pair, g_halfBand[j]);
+        }
+        float32x4x2_t interleaved = { { vld1q_f32(center + i), sum } };
+        vst2q_f32(out + 2 * i, interleaved);
+    }
+    half_band_scalar(center + i, count - i, out + 2 * i);
+}
+#endif
+
+// MARK: - Dispatch
+
+#if DSP_AVX2
+static bool cpu_has_avx2(void) {
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif
+
+static void convert(const int16_t *samples, float *out, int32_t count, float scale) {
+#if DSP_AVX2
+    if (cpu_has_avx2()) {
+        convert_avx2(samples, out, count, scale);
+        return;
+    }
+#endif
+#if DSP_NEON
+    convert_neon(samples, out, count, scale);
+#elif DSP_SSE2
+    convert_sse2(samples, out, count, scale);
+#else
+    convert_scalar(samples, out, count, scale);
+#endif
+}
+
+// The recurrence is four lanes wide, so AVX2 machines use the SSE2 kernel
+static void convert_dc_block(DSPDCBlocker *dc, const int16_t *samples, float *out, int32_t count, float scale) {
+#if DSP_NEON
+    dc_block_neon(dc, samples, out, count, scale);
+#elif DSP_SSE2
+    dc_block_sse2(dc, samples, out, count, scale);
+#else
+    dc_block_scalar(dc, samples, out, count, scale);
+#endif
+}
+
+void dectalk_convert_to_float(const int16_t *samples, float *out, int32_t count) {
+    if (!samples || !out || count <= 0) {
+        return;
+    }
+    convert(samples, out, count, kSampleScale);
+}
+
+static void half_band(const float *center, int32_t count, float *out) {
+#if DSP_AVX2
+    if (cpu_has_avx2()) {
+        half_band_avx2(center, count, out);
+        return;
+    }
+#endif
+#if DSP_NEON
+    half_band_neon(center, count, out);
+#elif DSP_SSE2
+    half_band_sse2(center, count, out);
+#else
+    half_band_scalar(center, count, out);
+#endif
+}
+
+int32_t dectalk_upsample_2x(const int16_t *samples, int32_t count, float *out) {
+    if (!samples || !out || count <= 0 || count > INT32_MAX / 2) {
+        return 0;
+    }
+
+    // Block of input as float with the filter's context around it,
+    // silence beyond either end of the input
+    float window[DSP_HALF_BAND_TAPS - 1 + DSP_BLOCK + DSP_HALF_BAND_TAPS];
+    float *center = window + DSP_HALF_BAND_TAPS - 1;
+
+    for (int32_t start = 0; start < count; start += DSP_BLOCK) {
+        int32_t length = count - start < DSP_BLOCK ? count - start : DSP_BLOCK;
+        int32_t first = start - (DSP_HALF_BAND_TAPS - 1);
+        int32_t last = start + length + DSP_HALF_BAND_TAPS;
+        int32_t from = first < 0 ? 0 : first;
+        int32_t to = last > count ? count : last;
+
+        int32_t filled = (from - first) + (to - from);
+        memset(window, 0, (size_t)(from - first) * sizeof(float));
+        dectalk_convert_to_float(samples + from, window + (from - first), to - from);
+        memset(window + filled, 0, (size_t)(last - first - filled) * sizeof(float));
+        half_band(center, length, out + 2 * start);
+    }
+    return count * 2;
+}
+
+// MARK: - Resampler
+//
+// Rational polyphase resampler. With the rates reduced to down -> up, output
+// sample n lies at input time n * down / up and is the dot product of the taps
+// input samples around that time with the coefficient row of phase
+// (n * down) mod up. Rows are built once per rate pair and shared.
+
+// Taps per output sample when upsampling; downsampling widens the filter by the ratio
+#define RESAMPLER_TAPS 32
+#define RESAMPLER_MAX_TAPS 128
+
+// Most output positions between two input samples
+#define RESAMPLER_MAX_PHASES 4096
+
+// Cutoff relative to the lower of the two Nyquist frequencies, and the window shape
+#define RESAMPLER_CUTOFF 0.92
+#define RESAMPLER_KAISER_BETA 8.0
+
+// Input samples converted to float per pass
+#define RESAMPLER_BLOCK 1024
+
+// Rate pairs whose filters are kept for later resamplers
+#define RESAMPLER_CACHED_FILTERS 8
+
+typedef float (*DSPDotProduct)(const float *a, const float *b, int32_t count);
+
+typedef struct {
+    int inputRate;
+    int outputRate;
+    int32_t up;
+    int32_t down;
+    int32_t taps;           // Multiple of 8
+    float *rows;            // up rows of taps coefficients
+} DSPFilter;
+
+struct dectalk_resampler {
+    DSPFilter *filter;
+    bool ownsFilter;        // Not in the shared cache, freed with the resampler
+    DSPDotProduct dot;
+
+    // Input not yet fully used, as float, starting at input index historyStart
+    float *history;
+    int32_t historyCount;
+    int64_t historyStart;
+    int64_t inputCount;
+
+    // Next output sample: the input index at or before it and its phase
+    int64_t position;
+    int32_t phase;
+};
+
+static pthread_mutex_t g_filterMutex = PTHREAD_MUTEX_INITIALIZER;
+static DSPFilter *g_filters[RESAMPLER_CACHED_FILTERS];
+
+// Dot products over a multiple of 8 floats
+
+#if !DSP_SSE2 && !DSP_NEON
+static float dot_scalar(const float *a, const float *b, int32_t count) {
+    float sum = 0.0f;
+    for (int32_t i = 0; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+#endif
+
+#if DSP_SSE2
+static float dot_sse2(const float *a, const float *b, int32_t count) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (int32_t i = 0; i < count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+#if DSP_AVX2
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float *a, const float *b, int32_t count) {
+    __m256 sum8 = _mm256_setzero_ps();
+    for (int32_t i = 0; i < count; i += 8) {
+        sum8 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum8);
+    }
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+#if DSP_NEON
+static float dot_neon(const float *a, const float *b, int32_t count) {
+    float32x4_t sum0 = vdupq_n_f32(0.0f);
+    float32x4_t sum1 = vdupq_n_f32(0.0f);
+    for (int32_t i = 0; i < count; i += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t sum = vaddq_f32(sum0, sum1);
+#if defined(__aarch64__)
+    return vaddvq_f32(sum);
+#else
+    float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+}
+#endif
+
+static DSPDotProduct dot_product(void) {
+#if DSP_AVX2
+    if (cpu_has_avx2()) {
+        return dot_avx2;
+    }
+#endif
+#if DSP_NEON
+    return dot_neon;
+#elif DSP_SSE2
+    return dot_sse2;
+#else
+    return dot_scalar;
+#endif
+}
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static int32_t greatest_common_divisor(int32_t a, int32_t b) {
+    while (b != 0) {
+        int32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void filter_free(DSPFilter *filter) {
+    if (filter) {
+        free(filter->rows);
+        free(filter);
+    }
+}
+
+static DSPFilter *filter_create(int inputRate, int outputRate) {
+    int32_t divisor = greatest_common_divisor(inputRate, outputRate);
+    int32_t up = outputRate / divisor;
+    int32_t down = inputRate / divisor;
+    if (up > RESAMPLER_MAX_PHASES) {
+        return NULL;
+    }
+
+    // A lower output rate needs a proportionally longer filter for the same transition band
+    double ratio = (double)up / (double)down;
+    int32_t taps = RESAMPLER_TAPS;
+    if (ratio < 1.0) {
+        taps = ((int32_t)ceil(RESAMPLER_TAPS / ratio) + 7) & ~7;
+    }
+    if (taps > RESAMPLER_MAX_TAPS) {
+        return NULL;
+    }
+
+    DSPFilter *filter = (DSPFilter*)calloc(1, sizeof(DSPFilter));
+    void *rows = NULL;
+    if (!filter || posix_memalign(&rows, 32, (size_t)up * (size_t)taps * sizeof(float)) != 0) {
+        free(filter);
+        return NULL;
+    }
+    filter->inputRate = inputRate;
+    filter->outputRate = outputRate;
+    filter->up = up;
+    filter->down = down;
+    filter->taps = taps;
+    filter->rows = (float*)rows;
+
+    double cutoff = RESAMPLER_CUTOFF * (ratio < 1.0 ? ratio : 1.0);
+    double half = taps / 2;
+    double windowScale = 1.0 / bessel_i0(RESAMPLER_KAISER_BETA);
+
+    for (int32_t phase = 0; phase < up; phase++) {
+        float *row = filter->rows + (size_t)phase * taps;
+        double coefficients[RESAMPLER_MAX_TAPS];
+        double sum = 0.0;
+
+        // Tap k weighs the input sample at distance d before the output sample
+        for (int32_t k = 0; k < taps; k++) {
+            double d = (double)phase / up + (half - 1 - k);
+            double x = d / half;
+            double window = x * x < 1.0 ? bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1.0 - x * x)) * windowScale : 0.0;
+            double sinc = d == 0.0 ? 1.0 : sin(M_PI * cutoff * d) / (M_PI * cutoff * d);
+            coefficients[k] = cutoff * sinc * window;
+            sum += coefficients[k];
+        }
+
+        // Unity gain at DC for every phase
+        for (int32_t k = 0; k < taps; k++) {
+            row[k] = (float)(coefficients[k] / sum);
+        }
+    }
+    return filter;
+}
+
+// Find or build the filter for a rate pair
+// owned is set if the cache is full and the caller must free the filter
+static DSPFilter *filter_acquire(int inputRate, int outputRate, bool *owned) {
+    pthread_mutex_lock(&g_filterMutex);
+
+    int32_t freeSlot = -1;
+    for (int32_t i = 0; i < RESAMPLER_CACHED_FILTERS; i++) {
+        DSPFilter *filter = g_filters[i];
+        if (filter && filter->inputRate == inputRate && filter->outputRate == outputRate) {
+            pthread_mutex_unlock(&g_filterMutex);
+            *owned = false;
+            return filter;
+        }
+        if (!filter && freeSlot < 0) {
+            freeSlot = i;
+        }
+    }
+
+    DSPFilter *filter = filter_create(inputRate, outputRate);
+    *owned = freeSlot < 0;
+    if (filter && freeSlot >= 0) {
+        g_filters[freeSlot] = filter;
+    }
+
+    pthread_mutex_unlock(&g_filterMutex);
+    return filter;
+}
+
+static int16_t sample_from_float(float value) {
+    value *= 32768.0f;
+    if (value > 32767.0f) {
+        value = 32767.0f;
+    } else if (value < -32768.0f) {
+        value = -32768.0f;
+    }
+    return (int16_t)lrintf(value);
+}
+
+dectalk_resampler_t *dectalk_resampler_create(int inputRate, int outputRate) {
+    if (inputRate <= 0 || outputRate <= 0) {
+        return NULL;
+    }
+
+    dectalk_resampler_t *resampler = (dectalk_resampler_t*)calloc(1, sizeof(dectalk_resampler_t));
+    if (!resampler) {
+        return NULL;
+    }
+
+    resampler->filter = filter_acquire(inputRate, outputRate, &resampler->ownsFilter);
+    if (resampler->filter) {
+        resampler->history = (float*)malloc((size_t)(resampler->filter->taps - 1 + RESAMPLER_BLOCK) * sizeof(float));
+    }
+    if (!resampler->history) {
+        dectalk_resampler_destroy(resampler);
+        return NULL;
+    }
+
+    resampler->dot = dot_product();
+    dectalk_resampler_reset(resampler);
+    return resampler;
+}
+
+void dectalk_resampler_destroy(dectalk_resampler_t *resampler) {
+    if (!resampler) {
+        return;
+    }
+    if (resampler->ownsFilter) {
+        filter_free(resampler->filter);
+    }
+    free(resampler->history);
+    free(resampler);
+}
+
+void dectalk_resampler_reset(dectalk_resampler_t *resampler) {
+    if (!resampler) {
+        return;
+    }
+
+    // Silence before the stream, so the first output sample has its full context
+    int32_t before = resampler->filter->taps / 2 - 1;
+    memset(resampler->history, 0, (size_t)before * sizeof(float));
+    resampler->historyCount = before;
+    resampler->historyStart = -before;
+    resampler->inputCount = 0;
+    resampler->position = 0;
+    resampler->phase = 0;
+}
+
+int32_t dectalk_resampler_max_output(const dectalk_resampler_t *resampler, int32_t count) {
+    if (!resampler || count < 0) {
+        return 0;
+    }
+    // Input still waiting for its context produces output as well
+    const DSPFilter *filter = resampler->filter;
+    int64_t maximum = ((int64_t)count + filter->taps) * filter->up / filter->down + 1;
+    return maximum > INT32_MAX ? INT32_MAX : (int32_t)maximum;
+}
+
+// Produce every output sample before end whose context is in the history,
+// then drop the input no later output sample needs
+// Samples go to floatOut as they are if it is set, otherwise to out as 16-bit
+static int32_t resampler_run(dectalk_resampler_t *resampler, int64_t end, int16_t *out, float *floatOut) {
+    const DSPFilter *filter = resampler->filter;
+    int32_t half = filter->taps / 2;
+    int64_t available = resampler->historyStart + resampler->historyCount;
+    int32_t produced = 0;
+
+    while (resampler->position + half < available && resampler->position < end) {
+        const float *context = resampler->history + (resampler->position - half + 1 - resampler->historyStart);
+        const float *row = filter->rows + (size_t)resampler->phase * (size_t)filter->taps;
+        float value = resampler->dot(row, context, filter->taps);
+        if (floatOut) {
+            floatOut[produced++] = value;
+        } else {
+            out[produced++] = sample_from_float(value);
+        }
+
+        resampler->phase += filter->down;
+        resampler->position += resampler->phase / filter->up;
+        resampler->phase %= filter->up;
+    }
+
+    int64_t drop = resampler->position - half + 1 - resampler->historyStart;
+    if (drop > resampler->historyCount) {
+        drop = resampler->historyCount;
+    }
+    if (drop > 0) {
+        resampler->historyCount -= (int32_t)drop;
+        memmove(resampler->history, resampler->history + drop, (size_t)resampler->historyCount * sizeof(float));
+        resampler->historyStart += drop;
+    }
+    return produced;
+}
+
+// Convert input straight into the history, scaled and DC blocked if dc is set,
+// and resample it to out or floatOut
+static int32_t resampler_process(dectalk_resampler_t *resampler, const int16_t *samples, int32_t count,
+                                 float scale, DSPDCBlocker *dc, int16_t *out, float *floatOut) {
+    int32_t produced = 0;
+    while (count > 0) {
+        int32_t length = count < RESAMPLER_BLOCK ? count : RESAMPLER_BLOCK;
+        float *input = resampler->history + resampler->historyCount;
+        if (dc) {
+            convert_dc_block(dc, samples, input, length, scale);
+        } else {
+            convert(samples, input, length, scale);
+        }
+        resampler->historyCount += length;
+        resampler->inputCount += length;
+
+        produced += resampler_run(resampler, INT64_MAX, out ? out + produced : NULL,
+                                  floatOut ? floatOut + produced : NULL);
+        samples += length;
+        count -= length;
+    }
+    return produced;
+}
+
+static int32_t resampler_flush(dectalk_resampler_t *resampler, int16_t *out, float *floatOut) {
+    // Silence after the stream gives the last output samples their context
+    int32_t after = resampler->filter->taps / 2;
+    memset(resampler->history + resampler->historyCount, 0, (size_t)after * sizeof(float));
+    resampler->historyCount += after;
+
+    int32_t produced = resampler_run(resampler, resampler->inputCount, out, floatOut);
+    dectalk_resampler_reset(resampler);
+    return produced;
+}
+
+int32_t dectalk_resampler_process(dectalk_resampler_t *resampler, const int16_t *samples,
+                                  int32_t count, int16_t *out) {
+    if (!resampler || !samples || !out || count <= 0) {
+        return 0;
+    }
+    return resampler_process(resampler, samples, count, kSampleScale, NULL, out, NULL);
+}
+
+int32_t dectalk_resampler_flush(dectalk_resampler_t *resampler, int16_t *out) {
+    if (!resampler || !out) {
+        return 0;
+    }
+    return resampler_flush(resampler, out, NULL);
+}
+
+// MARK: - Float output
+//
+// Conversion, gain and DC blocking happen in one loop over the engine samples.
+// Without resampling it writes the caller's buffer; with resampling it writes
+// the resampler's input, whose dot products then write the caller's buffer.
+
+struct dectalk_float_pipeline {
+    float scale;                        // kSampleScale times the gain
+    bool dcBlock;
+    DSPDCBlocker dc;
+    dectalk_resampler_t *resampler;     // NULL at equal rates
+};
+
+dectalk_float_pipeline_t *dectalk_float_pipeline_create(int inputRate, int outputRate,
+                                                        float gain, bool dcBlock) {
+    if (inputRate <= 0 || outputRate <= 0 || !isfinite(gain)) {
+        return NULL;
+    }
+
+    dectalk_float_pipeline_t *pipeline = (dectalk_float_pipeline_t*)calloc(1, sizeof(dectalk_float_pipeline_t));
+    if (!pipeline) {
+        return NULL;
+    }
+    if (inputRate != outputRate) {
+        pipeline->resampler = dectalk_resampler_create(inputRate, outputRate);
+        if (!pipeline->resampler) {
+            free(pipeline);
+            return NULL;
+        }
+    }
+
+    pipeline->scale = kSampleScale * gain;
+    pipeline->dcBlock = dcBlock;
+    pipeline->dc.pole = (float)exp(-2.0 * M_PI * DSP_DC_CUTOFF / inputRate);
+    float power = 1.0f;
+    for (int i = 0; i < 4; i++) {
+        power *= pipeline->dc.pole;
+        pipeline->dc.powers[i] = power;
+    }
+    return pipeline;
+}
+
+void dectalk_float_pipeline_destroy(dectalk_float_pipeline_t *pipeline) {
+    if (pipeline) {
+        dectalk_resampler_destroy(pipeline->resampler);
+        free(pipeline);
+    }
+}
+
+int32_t dectalk_float_pipeline_max_output(const dectalk_float_pipeline_t *pipeline, int32_t count) {
+    if (!pipeline || count < 0) {
+        return 0;
+    }
+    return pipeline->resampler ? dectalk_resampler_max_output(pipeline->resampler, count) : count;
+}
+
+int32_t dectalk_float_pipeline_process(dectalk_float_pipeline_t *pipeline, const int16_t *samples,
+                                       int32_t count, float *out) {
+    if (!pipeline || !samples || !out || count <= 0) {
+        return 0;
+    }
+
+    DSPDCBlocker *dc = pipeline->dcBlock ? &pipeline->dc : NULL;
+    if (pipeline->resampler) {
+        return resampler_process(pipeline->resampler, samples, count, pipeline->scale, dc, NULL, out);
+    }
+    if (dc) {
+        convert_dc_block(dc, samples, out, count, pipeline->scale);
+    } else {
+        convert(samples, out, count, pipeline->scale);
+    }
+    return count;
+}
+
+int32_t dectalk_float_pipeline_flush(dectalk_float_pipeline_t *pipeline, float *out) {
+    if (!pipeline || !out) {
+        return 0;
+    }
+
+    pipeline->dc.lastInput = 0.0f;
+    pipeline->dc.lastOutput = 0.0f;
+    return pipeline->resampler ? resampler_flush(pipeline->resampler, NULL, out) : 0;
+}
+
+// MARK: - Sound detection
+//
+// A sample is sound when its magnitude exceeds the threshold. The vector
+// kernels compare a whole vector against the threshold and only look at single
+// samples in the vector where something crossed it.
+
+static inline bool is_sound(int16_t sample, int16_t threshold) {
+    return sample > threshold || sample < -threshold;
+}
+
+static int32_t first_sound_scalar(const int16_t *samples, int32_t count, int16_t threshold) {
+    for (int32_t i = 0; i < count; i++) {
+        if (is_sound(samples[i], threshold)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int32_t last_sound_scalar(const int16_t *samples, int32_t count, int16_t threshold) {
+    for (int32_t i = count - 1; i >= 0; i--) {
+        if (is_sound(samples[i], threshold)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if DSP_SSE2
+// One bit pair per 16-bit lane louder than threshold
+static inline int sound_mask_sse2(const int16_t *samples, __m128i high, __m128i low) {
+    __m128i v = _mm_loadu_si128((const __m128i *)samples);
+    return _mm_movemask_epi8(_mm_or_si128(_mm_cmpgt_epi16(v, high), _mm_cmplt_epi16(v, low)));
+}
+
+static int32_t first_sound_sse2(const int16_t *samples, int32_t count, int16_t threshold) {
+    const __m128i high = _mm_set1_epi16(threshold);
+    const __m128i low = _mm_set1_epi16((int16_t)-threshold);
+    int32_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        int mask = sound_mask_sse2(samples + i, high, low);
+        if (mask) {
+            return i + __builtin_ctz((unsigned)mask) / 2;
+        }
+    }
+    int32_t tail = first_sound_scalar(samples + i, count - i, threshold);
+    return tail < 0 ? -1 : i + tail;
+}
+
+static int32_t last_sound_sse2(const int16_t *samples, int32_t count, int16_t threshold) {
+    const __m128i high = _mm_set1_epi16(threshold);
+    const __m128i low = _mm_set1_epi16((int16_t)-threshold);
+    int32_t i = count;
+
+    for (; i >= 8; i -= 8) {
+        int mask = sound_mask_sse2(samples + i - 8, high, low);
+        if (mask) {
+            return i - 8 + (31 - __builtin_clz((unsigned)mask)) / 2;
+        }
+    }
+    return last_sound_scalar(samples, i, threshold);
+}
+#endif
+
+#if DSP_AVX2
+__attribute__((target("avx2")))
+static inline uint32_t sound_mask_avx2(const int16_t *samples, __m256i high, __m256i low) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)samples);
+    __m256i sound = _mm256_or_si256(_mm256_cmpgt_epi16(v, high), _mm256_cmpgt_epi16(low, v));
+    return (uint32_t)_mm256_movemask_epi8(sound);
+}
+
+__attribute__((target("avx2")))
+static int32_t first_sound_avx2(const int16_t *samples, int32_t count, int16_t threshold) {
+    const __m256i high = _mm256_set1_epi16(threshold);
+    const __m256i low = _mm256_set1_epi16((int16_t)-threshold);
+    int32_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        uint32_t mask = sound_mask_avx2(samples + i, high, low);
+        if (mask) {
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+    int32_t tail = first_sound_scalar(samples + i, count - i, threshold);
+    return tail < 0 ? -1 : i + tail;
+}
+
+__attribute__((target("avx2")))
+static int32_t last_sound_avx2(const int16_t *samples, int32_t count, int16_t threshold) {
+    const __m256i high = _mm256_set1_epi16(threshold);
+    const __m256i low = _mm256_set1_epi16((int16_t)-threshold);
+    int32_t i = count;
+
+    for (; i >= 16; i -= 16) {
+        uint32_t mask = sound_mask_avx2(samples + i - 16, high, low);
+        if (mask) {
+            return i - 16 + (31 - __builtin_clz(mask)) / 2;
+        }
+    }
+    return last_sound_scalar(samples, i, threshold);
+}
+#endif
+
+#if DSP_NEON
+static inline bool any_sound_neon(const int16_t *samples, int16x8_t high, int16x8_t low) {
+    int16x8_t v = vld1q_s16(samples);
+    uint16x8_t sound = vorrq_u16(vcgtq_s16(v, high), vcltq_s16(v, low));
+    uint64x2_t lanes = vreinterpretq_u64_u16(sound);
+    return (vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0;
+}
+
+static int32_t first_sound_neon(const int16_t *samples, int32_t count, int16_t threshold) {
+    const int16x8_t high = vdupq_n_s16(threshold);
+    const int16x8_t low = vdupq_n_s16((int16_t)-threshold);
+    int32_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        if (any_sound_neon(samples + i, high, low)) {
+            return i + first_sound_scalar(samples + i, 8, threshold);
+        }
+    }
+    int32_t tail = first_sound_scalar(samples + i, count - i, threshold);
+    return tail < 0 ? -1 : i + tail;
+}
+
+static int32_t last_sound_neon(const int16_t *samples, int32_t count, int16_t threshold) {
+    const int16x8_t high = vdupq_n_s16(threshold);
+    const int16x8_t low = vdupq_n_s16((int16_t)-threshold);
+    int32_t i = count;
+
+    for (; i >= 8; i -= 8) {
+        if (any_sound_neon(samples + i - 8, high, low)) {
+            return i - 8 + last_sound_scalar(samples + i - 8, 8, threshold);
+        }
+    }
+    return last_sound_scalar(samples, i, threshold);
+}
+#endif
+
+int32_t dectalk_find_first_sound(const int16_t *samples, int32_t count, int16_t threshold) {
+    if (!samples || count <= 0) {
+        return -1;
+    }
+    if (threshold < 0) {
+        threshold = 0;
+    }
+#if DSP_AVX2
+    if (cpu_has_avx2()) {
+        return first_sound_avx2(samples, count, threshold);
+    }
+#endif
+#if DSP_NEON
+    return first_sound_neon(samples, count, threshold);
+#elif DSP_SSE2
+    return first_sound_sse2(samples, count, threshold);
+#else
+    return first_sound_scalar(samples, count, threshold);
+#endif
+}
+
+int32_t dectalk_find_last_sound(const int16_t *samples, int32_t count, int16_t threshold) {
+    if (!samples || count <= 0) {
+        return -1;
+    }
+    if (threshold < 0) {
+        threshold = 0;
+    }
+#if DSP_AVX2
+    if (cpu_has_avx2()) {
+        return last_sound_avx2(samples, count, threshold);
+    }
+#endif
+#if DSP_NEON
+    return last_sound_neon(samples, count, threshold);
+#elif DSP_SSE2
+    return last_sound_sse2(samples, count, threshold);
+#else
+    return last_sound_scalar(samples, count, threshold);
+#endif
+}
+
+// MARK: - G.711
+
+#define MULAW_BIAS 0x84
+#define MULAW_CLIP 32635
+
+// Segment (exponent) and 4-bit mantissa of the biased magnitude, ITU-T G.711
+static uint8_t mulaw_encode(int16_t sample) {
+    int value = sample;
+    uint8_t sign = 0;
+    if (value < 0) {
+        // One's complement, as in the ITU-T G.191 reference, so -1 encodes like 0
+        sign = 0x80;
+        value = -value - 1;
+    }
+    if (value > MULAW_CLIP) {
+        value = MULAW_CLIP;
+    }
+    value += MULAW_BIAS;
+
+    // The bias sets bit 7, so the top bit is between 7 and 14
+    int exponent = 31 - __builtin_clz((unsigned)value) - 7;
+    int mantissa = (value >> (exponent + 3)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+static uint8_t alaw_encode(int16_t sample) {
+    int value = sample >> 3;
+    uint8_t mask = 0xD5;
+    if (value < 0) {
+        mask = 0x55;
+        value = -value - 1;
+    }
+
+    // 13-bit magnitude: segment 0 is linear, each later one doubles the step
+    int segment = value < 32 ? 0 : 31 - __builtin_clz((unsigned)value) - 4;
+    int mantissa = (value >> (segment < 2 ? 1 : segment)) & 0x0F;
+    return (uint8_t)((segment << 4) | mantissa) ^ mask;
+}
+
+void dectalk_encode_g711(const int16_t *samples, int32_t count, DECtalkG711Law law, uint8_t *out) {
+    if (!samples || !out || count <= 0) {
+        return;
+    }
+
+    if (law == DECtalkG711ALaw) {
+        for (int32_t i = 0; i < count; i++) {
+            out[i] = alaw_encode(samples[i]);
+        }
+    } else {
+        for (int32_t i = 0; i < count; i++) {
+            out[i] = mulaw_encode(samples[i]);
+        }
+    }
+}
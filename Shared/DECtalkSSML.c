@@ -0,0 +1,1791 @@
+/*
+ * DECtalkSSML.c
+ * Single-pass SSML to DECtalk compiler
+ */
+
+#include "DECtalkBridge.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+
+// Open elements tracked for matching closing tags, deeper ones are ignored
+#define SSML_MAX_DEPTH 32
+
+// Longest say-as content that is normalized, longer content is spoken as is
+#define SSML_SAY_AS_MAX 256
+
+// Longest attribute value that is read, longer values are cut off
+#define SSML_ATTRIBUTE_MAX 128
+
+// Longest pause a <break> asks for (ms)
+#define SSML_PAUSE_MAX 60000
+
+// Default pitch (Hz) for each voice - from DECtalk documentation
+static const int g_voiceBasePitch[DECtalkVoiceCount] = {
+    122,  // Paul
+    208,  // Betty
+    89,   // Harry
+    155,  // Frank
+    110,  // Dennis
+    296,  // Kit
+    240,  // Ursula
+    106,  // Rita
+    200   // Wendy
+};
+
+// DECtalk commands that arrive with their '[' stripped by the system,
+// i.e. ':command]' in the text is turned back into '[:command]'
+static const char *g_inlineCommands[] = {
+    "rate", "volume", "pitch", "np", "nb", "nh", "nf", "nd", "nk", "nu", "nr", "nw",
+    "dv", "phoneme", "punct", "tone", "comma", "period", "log", "error", "index",
+    "sync", "play", "dial", "mode", "say", "skip", "email", "latin", "name", "note",
+    "pronounce", "pp", "cp", "design", "gender", "breath", "head", "smooth",
+    "richness", "lx", "hs", "f4", "b4", "f5", "b5", "lo", "speed", "pause"
+};
+
+// MARK: - Output
+
+// Compiled output, counted in full but only stored as far as it fits (snprintf style)
+typedef struct {
+    char *out;
+    int32_t size;
+    int32_t length;
+    char last;      // Last text character written, 0 at the start; commands don't count
+} SSMLWriter;
+
+static void writer_put(SSMLWriter *writer, char c) {
+    if (writer->length < writer->size - 1) {
+        writer->out[writer->length] = c;
+    }
+    if (writer->length < INT32_MAX - 1) {
+        writer->length++;
+    }
+}
+
+// Write spoken text
+static void writer_text(SSMLWriter *writer, const char *text, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (writer->length < writer->size - 1) {
+        size_t room = (size_t)(writer->size - 1 - writer->length);
+        memcpy(writer->out + writer->length, text, length < room ? length : room);
+    }
+    writer->length = length < (size_t)(INT32_MAX - 1 - writer->length) ? writer->length + (int32_t)length : INT32_MAX - 1;
+    writer->last = text[length - 1];
+}
+
+static void writer_char(SSMLWriter *writer, char c) {
+    writer_text(writer, &c, 1);
+}
+
+static void writer_vformat(SSMLWriter *writer, bool spoken, const char *format, va_list args) {
+    char text[128];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(text)) {
+        length = (int)sizeof(text) - 1;
+    }
+
+    if (spoken) {
+        writer_text(writer, text, (size_t)length);
+    } else {
+        for (int i = 0; i < length; i++) {
+            writer_put(writer, text[i]);
+        }
+    }
+}
+
+// Write an inline command, it doesn't affect word boundaries
+static void writer_command(SSMLWriter *writer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    writer_vformat(writer, false, format, args);
+    va_end(args);
+}
+
+// Separate the words on both sides of a block boundary
+static void writer_boundary(SSMLWriter *writer) {
+    if (writer->last != 0 && !isspace((unsigned char)writer->last)) {
+        writer_char(writer, ' ');
+    }
+}
+
+// MARK: - Character set
+
+// The engine reads ISO 8859-1. Text arrives as UTF-8 and is transcoded one code
+// point at a time: Latin-1 is kept, typographic punctuation becomes ASCII, letters
+// without a Latin-1 form lose their accent, a few symbols are spoken as words and
+// anything else the engine can't say (emoji, other scripts) becomes a space.
+
+// Length of a UTF-8 sequence by its lead byte, 0 for bytes that can't start one
+static const uint8_t g_utf8Length[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+// Smallest code point of each sequence length, shorter forms are overlong
+static const uint32_t g_utf8Minimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+// Decode the UTF-8 sequence at text, which ends at end
+// A byte that doesn't start a valid sequence is taken as a Latin-1 character,
+// so text that is already in the engine's character set passes unchanged.
+// Returns the number of bytes consumed.
+static size_t utf8_decode(const char *text, const char *end, uint32_t *codePoint) {
+    const uint8_t *bytes = (const uint8_t*)text;
+    size_t length = g_utf8Length[bytes[0]];
+
+    if (length > 1 && (size_t)(end - text) >= length) {
+        uint32_t value = bytes[0] & (0x7F >> length);
+        size_t i = 1;
+        while (i < length && (bytes[i] & 0xC0) == 0x80) {
+            value = (value << 6) | (bytes[i] & 0x3F);
+            i++;
+        }
+        if (i == length && value >= g_utf8Minimum[length] && value <= 0x10FFFF &&
+            (value < 0xD800 || value > 0xDFFF)) {
+            *codePoint = value;
+            return length;
+        }
+    }
+
+    *codePoint = bytes[0];
+    return 1;
+}
+
+// Engine characters for Latin Extended-A (U+0100-U+017F), accents removed
+static const char g_latinExtendedA[128] =
+    "AaAaAaCcCcCcCcDdDdEeEeEeEeEeGgGg"
+    "GgGgHhHhIiIiIiIiIiIiJjKkkLlLlLlL"
+    "lLlNnNnNnnNnOoOoOoOoRrRrRrSsSsSs"
+    "SsTtTtTtUuUuUuUuUuUuWwYyYZzZzZzs";
+
+// Replacements outside of Latin-1, sorted by code point
+static const struct {
+    uint32_t codePoint;
+    const char *text;
+} g_replacements[] = {
+    {0x0132, "IJ"}, {0x0133, "ij"}, {0x0152, "OE"}, {0x0153, "oe"},
+    {0x0192, "f"}, {0x02BC, "'"}, {0x02C6, "^"}, {0x02DC, "~"},
+    {0x2010, "-"}, {0x2011, "-"}, {0x2012, "-"}, {0x2013, "-"}, {0x2014, ", "}, {0x2015, ", "},
+    {0x2018, "'"}, {0x2019, "'"}, {0x201A, "'"}, {0x201B, "'"},
+    {0x201C, "\""}, {0x201D, "\""}, {0x201E, "\""}, {0x201F, "\""},
+    {0x2020, " dagger "}, {0x2021, " double dagger "}, {0x2022, ", "}, {0x2026, "..."},
+    {0x2030, " per mille "}, {0x2032, "'"}, {0x2033, "\""}, {0x2039, "'"}, {0x203A, "'"},
+    {0x2044, "/"}, {0x20AC, " euro "}, {0x2116, " number "}, {0x2122, " trademark "},
+    {0x2212, "-"}, {0x2215, "/"}, {0x221E, " infinity "}, {0x2248, " approximately "},
+    {0x2260, " not equal to "}, {0x2264, " less than or equal to "},
+    {0x2265, " greater than or equal to "}, {0xFB01, "fi"}, {0xFB02, "fl"}
+};
+
+// Whether a code point is only a modifier of its neighbors and is dropped
+static bool engine_ignores(uint32_t codePoint) {
+    return codePoint == 0xAD ||                                 // Soft hyphen
+           (codePoint >= 0x0300 && codePoint <= 0x036F) ||      // Combining diacritics
+           (codePoint >= 0x200B && codePoint <= 0x200F) ||      // Zero width, direction marks
+           codePoint == 0x2060 || codePoint == 0xFEFF ||        // Word joiner, byte order mark
+           (codePoint >= 0xFE00 && codePoint <= 0xFE0F) ||      // Variation selectors
+           (codePoint >= 0x1F3FB && codePoint <= 0x1F3FF);      // Skin tone modifiers
+}
+
+// Engine text for a code point
+// Returns the text and stores its length, single is used as storage for one character
+static const char *engine_text(uint32_t codePoint, char *single, size_t *length) {
+    *length = 1;
+
+    // ASCII and Latin-1, C1 controls and no-break space become spaces
+    if (codePoint < 0x80 || (codePoint > 0xA0 && codePoint <= 0xFF && codePoint != 0xAD)) {
+        *single = (char)codePoint;
+        return single;
+    }
+    if (codePoint <= 0xA0) {
+        return " ";
+    }
+
+    if (engine_ignores(codePoint)) {
+        *length = 0;
+        return "";
+    }
+
+    size_t low = 0, high = sizeof(g_replacements) / sizeof(g_replacements[0]);
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (g_replacements[middle].codePoint < codePoint) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < sizeof(g_replacements) / sizeof(g_replacements[0]) && g_replacements[low].codePoint == codePoint) {
+        *length = strlen(g_replacements[low].text);
+        return g_replacements[low].text;
+    }
+
+    if (codePoint >= 0x100 && codePoint <= 0x17F) {
+        *single = g_latinExtendedA[codePoint - 0x100];
+        return single;
+    }
+
+    // Fullwidth forms of ASCII
+    if (codePoint >= 0xFF01 && codePoint <= 0xFF5E) {
+        *single = (char)(codePoint - 0xFEE0);
+        return single;
+    }
+
+    return " ";
+}
+
+// Bytes in a 64-bit word that equal c have their high bit set
+// Only the lowest flagged byte is exact, a borrow can flag bytes above it
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+static inline uint64_t swar_equal(uint64_t word, uint8_t c) {
+    uint64_t x = word ^ (SWAR_ONES * c);
+    return (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+}
+
+// Length of the run of ASCII text at text that needs no further attention:
+// up to the first byte of markup ('<'), an entity ('&'), a possibly stripped
+// command (':'), a non-ASCII character or end. Scans 8 bytes at a time.
+static size_t ascii_run(const char *text, const char *end, bool markup) {
+    const char *p = text;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        uint64_t stop = word & SWAR_HIGHS;
+        if (markup) {
+            stop |= swar_equal(word, '<') | swar_equal(word, '&') | swar_equal(word, ':');
+        }
+        if (stop) {
+            return (size_t)(p - text) + (size_t)(__builtin_ctzll(stop) / 8);
+        }
+        p += 8;
+    }
+#endif
+
+    while (p < end && (unsigned char)*p < 0x80 && (!markup || (*p != '<' && *p != '&' && *p != ':'))) {
+        p++;
+    }
+    return (size_t)(p - text);
+}
+
+int32_t dectalk_text_to_engine_charset(const char *text, char *out, int32_t outSize) {
+    if (text == NULL || outSize < 0 || (out == NULL && outSize > 0)) {
+        return -1;
+    }
+
+    SSMLWriter writer = { .out = out, .size = outSize };
+    const char *end = text + strlen(text);
+    const char *p = text;
+
+    while (p < end) {
+        size_t run = ascii_run(p, end, false);
+        writer_text(&writer, p, run);
+        p += run;
+
+        if (p < end) {
+            uint32_t codePoint;
+            char single;
+            size_t length;
+            p += utf8_decode(p, end, &codePoint);
+            const char *replacement = engine_text(codePoint, &single, &length);
+            writer_text(&writer, replacement, length);
+        }
+    }
+
+    if (outSize > 0) {
+        out[writer.length < outSize ? writer.length : outSize - 1] = '\0';
+    }
+    return writer.length;
+}
+
+// MARK: - Lexing
+
+// Decode the character entity at text
+// Returns the number of bytes consumed, 0 if text doesn't start a known entity
+static size_t ssml_decode_entity(const char *text, uint32_t *codePoint) {
+    static const struct { const char *name; char value; } entities[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}
+    };
+
+    if (text[0] != '&') {
+        return 0;
+    }
+
+    if (text[1] == '#') {
+        // Numeric entity, decimal &#NNN; or hexadecimal &#xHHHH;
+        bool hex = text[2] == 'x' || text[2] == 'X';
+        size_t start = hex ? 3 : 2;
+        size_t i = start;
+        uint32_t value = 0;
+        while (i < start + 7 && (hex ? isxdigit((unsigned char)text[i]) : isdigit((unsigned char)text[i]))) {
+            int digit = isdigit((unsigned char)text[i]) ? text[i] - '0' : (tolower((unsigned char)text[i]) - 'a' + 10);
+            value = value * (hex ? 16 : 10) + (uint32_t)digit;
+            i++;
+        }
+        if (i > start && text[i] == ';' && value > 0 && value <= 0x10FFFF) {
+            *codePoint = value;
+            return i + 1;
+        }
+        return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+        size_t length = strlen(entities[i].name);
+        if (strncmp(text, entities[i].name, length) == 0) {
+            *codePoint = (uint8_t)entities[i].value;
+            return length;
+        }
+    }
+    return 0;
+}
+
+// Whether text continues a stripped inline command, see g_inlineCommands
+// text points just past the ':'
+static bool ssml_is_stripped_command(const char *text) {
+    bool known = false;
+    for (size_t i = 0; i < sizeof(g_inlineCommands) / sizeof(g_inlineCommands[0]); i++) {
+        if (strncasecmp(text, g_inlineCommands[i], strlen(g_inlineCommands[i])) == 0) {
+            known = true;
+            break;
+        }
+    }
+    if (!known) {
+        return false;
+    }
+
+    // The command must be closed before the next tag
+    for (const char *p = text; *p && *p != '<'; p++) {
+        if (*p == ']') {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef enum {
+    SSMLElementOther = 0,
+    SSMLElementSpeak,
+    SSMLElementParagraph,
+    SSMLElementSentence,
+    SSMLElementProsody,
+    SSMLElementBreak,
+    SSMLElementEmphasis,
+    SSMLElementSayAs,
+    SSMLElementSub,
+    SSMLElementMark
+} SSMLElement;
+
+static const struct { const char *name; SSMLElement element; } g_elements[] = {
+    {"speak", SSMLElementSpeak},
+    {"p", SSMLElementParagraph},
+    {"paragraph", SSMLElementParagraph},
+    {"s", SSMLElementSentence},
+    {"sentence", SSMLElementSentence},
+    {"prosody", SSMLElementProsody},
+    {"break", SSMLElementBreak},
+    {"emphasis", SSMLElementEmphasis},
+    {"say-as", SSMLElementSayAs},
+    {"sub", SSMLElementSub},
+    {"mark", SSMLElementMark}
+};
+
+typedef struct {
+    SSMLElement element;
+    bool closing;           // </name>
+    bool selfClosing;       // <name/>
+    const char *attributes;
+    size_t attributesLength;
+} SSMLTag;
+
+// Parse the tag starting at '<'
+// Returns the position after its '>', or the end of the text for an unterminated tag
+static const char *ssml_parse_tag(const char *text, SSMLTag *tag) {
+    const char *p = text + 1;
+    memset(tag, 0, sizeof(*tag));
+
+    if (*p == '/') {
+        tag->closing = true;
+        p++;
+    }
+
+    const char *name = p;
+    while (*p && *p != '>' && *p != '/' && !isspace((unsigned char)*p)) {
+        p++;
+    }
+    size_t nameLength = (size_t)(p - name);
+
+    // Ignore a namespace prefix such as ssml:break
+    const char *colon = memchr(name, ':', nameLength);
+    if (colon) {
+        nameLength -= (size_t)(colon + 1 - name);
+        name = colon + 1;
+    }
+
+    tag->element = SSMLElementOther;
+    for (size_t i = 0; i < sizeof(g_elements) / sizeof(g_elements[0]); i++) {
+        if (strlen(g_elements[i].name) == nameLength &&
+            strncasecmp(name, g_elements[i].name, nameLength) == 0) {
+            tag->element = g_elements[i].element;
+            break;
+        }
+    }
+
+    // Attributes run up to the closing '>', quoted values may contain '>' or '/'
+    tag->attributes = p;
+    char quote = 0;
+    while (*p && (quote || *p != '>')) {
+        if (quote) {
+            if (*p == quote) {
+                quote = 0;
+            }
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        }
+        p++;
+    }
+    tag->attributesLength = (size_t)(p - tag->attributes);
+
+    const char *last = p;
+    while (last > tag->attributes && isspace((unsigned char)last[-1])) {
+        last--;
+    }
+    if (last > tag->attributes && last[-1] == '/') {
+        tag->selfClosing = true;
+        tag->attributesLength = (size_t)(last - 1 - tag->attributes);
+    }
+
+    return *p ? p + 1 : p;
+}
+
+// Copy the value of attribute name into value
+// Returns false if the tag doesn't have it
+static bool ssml_tag_attribute(const SSMLTag *tag, const char *name, char *value, size_t valueSize) {
+    const char *p = tag->attributes;
+    const char *end = tag->attributes + tag->attributesLength;
+    size_t nameLength = strlen(name);
+
+    while (p < end) {
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+        const char *attribute = p;
+        while (p < end && *p != '=' && !isspace((unsigned char)*p)) {
+            p++;
+        }
+        size_t attributeLength = (size_t)(p - attribute);
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (p >= end || *p != '=') {
+            continue;
+        }
+        p++;
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+
+        const char *start = p;
+        if (p < end && (*p == '"' || *p == '\'')) {
+            char quote = *p++;
+            start = p;
+            while (p < end && *p != quote) {
+                p++;
+            }
+        } else {
+            while (p < end && !isspace((unsigned char)*p)) {
+                p++;
+            }
+        }
+        size_t length = (size_t)(p - start);
+        if (p < end) {
+            p++;
+        }
+
+        if (attributeLength == nameLength && strncasecmp(attribute, name, nameLength) == 0) {
+            if (length >= valueSize) {
+                length = valueSize - 1;
+            }
+            memcpy(value, start, length);
+            value[length] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+// MARK: - Prosody
+
+// Rate, pitch and volume in DECtalk units
+typedef struct {
+    int rate;       // Words per minute
+    int pitch;      // Average pitch (Hz)
+    int volume;     // 0-100
+} SSMLProsody;
+
+// Ranges DECtalk accepts
+#define SSML_RATE_MIN 75
+#define SSML_RATE_MAX 650
+#define SSML_PITCH_MIN 50
+#define SSML_PITCH_MAX 350
+
+static int clamp_value(double value, int low, int high) {
+    return value < low ? low : value > high ? high : (int)value;
+}
+
+// Look up a keyword value such as "x-slow" in a table of multipliers
+typedef struct {
+    const char *name;
+    double multiplier;
+} SSMLKeyword;
+
+static bool ssml_keyword(const SSMLKeyword *keywords, size_t count, const char *value, double *multiplier) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcasecmp(value, keywords[i].name) == 0) {
+            *multiplier = keywords[i].multiplier;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Split a numeric value into number and unit
+// A signed number ("+10%", "-2st") is a change relative to the enclosing value
+static bool ssml_number(const char *value, double *number, const char **unit, bool *relative) {
+    while (isspace((unsigned char)*value)) {
+        value++;
+    }
+    *relative = *value == '+' || *value == '-';
+
+    char *end;
+    *number = strtod(value, &end);
+    if (end == value) {
+        return false;
+    }
+    *unit = end;
+    return true;
+}
+
+// New rate for an SSML rate value, current if it is not understood
+// Keywords and percentages scale the base rate, signed percentages the current one
+static int ssml_prosody_rate(const char *value, int base, int current) {
+    static const SSMLKeyword keywords[] = {
+        {"x-slow", 0.5}, {"slow", 0.75}, {"medium", 1.0}, {"fast", 1.5}, {"x-fast", 2.0}, {"default", 1.0}
+    };
+    double number;
+    const char *unit;
+    bool relative;
+
+    if (ssml_keyword(keywords, sizeof(keywords) / sizeof(keywords[0]), value, &number)) {
+        return clamp_value(base * number, SSML_RATE_MIN, SSML_RATE_MAX);
+    }
+    if (ssml_number(value, &number, &unit, &relative)) {
+        if (strcmp(unit, "%") == 0) {
+            double rate = relative ? current * (1.0 + number / 100.0) : base * number / 100.0;
+            return clamp_value(rate, SSML_RATE_MIN, SSML_RATE_MAX);
+        }
+        if (*unit == '\0' && !relative) {
+            return clamp_value(base * number, SSML_RATE_MIN, SSML_RATE_MAX);
+        }
+    }
+    return current;
+}
+
+// New pitch for an SSML pitch value, current if it is not understood
+// macOS pitch slider appears to use: 50% = normal, 0% = low, 100% = high
+static int ssml_prosody_pitch(const char *value, int base, int current) {
+    static const SSMLKeyword keywords[] = {
+        {"x-low", 0.5}, {"low", 0.75}, {"medium", 1.0}, {"high", 1.25}, {"x-high", 1.5}, {"default", 1.0}
+    };
+    double number;
+    const char *unit;
+    bool relative;
+
+    if (ssml_keyword(keywords, sizeof(keywords) / sizeof(keywords[0]), value, &number)) {
+        return clamp_value(base * number, SSML_PITCH_MIN, SSML_PITCH_MAX);
+    }
+    if (ssml_number(value, &number, &unit, &relative)) {
+        double pitch;
+        if (strcmp(unit, "%") == 0) {
+            // 0% -> 0.0, 50% -> 1.0, 100% -> 2.0 times the base pitch
+            pitch = relative ? current * (1.0 + number / 100.0) : base * number / 50.0;
+        } else if (strcasecmp(unit, "hz") == 0) {
+            // Rough conversion, assume 150 Hz is "normal"
+            pitch = relative ? current + number : base * number / 150.0;
+        } else if (strcasecmp(unit, "st") == 0 && relative) {
+            pitch = current * pow(2.0, number / 12.0);
+        } else {
+            return current;
+        }
+        // A zero pitch would mean silence, keep the enclosing one
+        return pitch > 0 ? clamp_value(pitch, SSML_PITCH_MIN, SSML_PITCH_MAX) : current;
+    }
+    return current;
+}
+
+// New volume for an SSML volume value, current if it is not understood
+static int ssml_prosody_volume(const char *value, int current) {
+    static const SSMLKeyword keywords[] = {
+        {"silent", 0.0}, {"x-soft", 0.25}, {"soft", 0.5}, {"medium", 0.75}, {"loud", 1.0}, {"x-loud", 1.0}
+    };
+    double number;
+    const char *unit;
+    bool relative;
+
+    if (ssml_keyword(keywords, sizeof(keywords) / sizeof(keywords[0]), value, &number)) {
+        return clamp_value(number * 100.0, 0, 100);
+    }
+    if (ssml_number(value, &number, &unit, &relative)) {
+        double volume;
+        if (strcmp(unit, "%") == 0) {
+            volume = relative ? current * (1.0 + number / 100.0) : number;
+        } else if (strcasecmp(unit, "db") == 0) {
+            volume = (relative ? current : 100.0) * pow(10.0, number / 20.0);
+        } else if (*unit == '\0' && !relative) {
+            volume = number;
+        } else {
+            return current;
+        }
+        return clamp_value(volume, 0, 100);
+    }
+    return current;
+}
+
+// Parse an SSML time value ("500ms", "1.5s") to milliseconds
+static int ssml_parse_time(const char *value) {
+    char *end;
+    double number = strtod(value, &end);
+    if (end != value) {
+        if (strcasecmp(end, "ms") == 0) {
+            return clamp_value(number, 0, SSML_PAUSE_MAX);
+        }
+        if (strcasecmp(end, "s") == 0) {
+            return clamp_value(number * 1000.0, 0, SSML_PAUSE_MAX);
+        }
+    }
+    return 250;
+}
+
+// MARK: - Say-as
+
+// Say-as content is normalized into words with lookup tables and a small scanner,
+// in one pass over the content and without allocating. Content the interpretation
+// doesn't match is spoken as is.
+
+static const char *g_ones[20] = {
+    "zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine", "ten",
+    "eleven", "twelve", "thirteen", "fourteen", "fifteen", "sixteen", "seventeen", "eighteen", "nineteen"
+};
+
+static const char *g_onesOrdinal[20] = {
+    "zeroth", "first", "second", "third", "fourth", "fifth", "sixth", "seventh", "eighth", "ninth", "tenth",
+    "eleventh", "twelfth", "thirteenth", "fourteenth", "fifteenth", "sixteenth", "seventeenth",
+    "eighteenth", "nineteenth"
+};
+
+static const char *g_tens[10] = {
+    "", "", "twenty", "thirty", "forty", "fifty", "sixty", "seventy", "eighty", "ninety"
+};
+
+static const char *g_tensOrdinal[10] = {
+    "", "", "twentieth", "thirtieth", "fortieth", "fiftieth", "sixtieth", "seventieth", "eightieth", "ninetieth"
+};
+
+// Powers of a thousand, with their ordinals
+static const char *g_scales[][2] = {
+    {"", ""}, {"thousand", "thousandth"}, {"million", "millionth"},
+    {"billion", "billionth"}, {"trillion", "trillionth"}, {"quadrillion", "quadrillionth"},
+    {"quintillion", "quintillionth"}
+};
+
+static const char *g_monthNames[12] = {
+    "January", "February", "March", "April", "May", "June",
+    "July", "August", "September", "October", "November", "December"
+};
+
+// Names of letters and symbols when spelling
+static const char *g_letterNames[26] = {
+    "ay", "bee", "see", "dee", "ee", "eff", "jee", "aitch", "eye", "jay", "kay", "el", "em",
+    "en", "oh", "pee", "cue", "ar", "ess", "tee", "you", "vee", "double you", "ex", "why", "zee"
+};
+
+static const char *g_symbolNames[128] = {
+    [' '] = "space", ['!'] = "exclamation mark", ['"'] = "quote", ['#'] = "number sign",
+    ['$'] = "dollar sign", ['%'] = "percent", ['&'] = "and", ['\''] = "apostrophe",
+    ['('] = "open paren", [')'] = "close paren", ['*'] = "star", ['+'] = "plus",
+    [','] = "comma", ['-'] = "dash", ['.'] = "dot", ['/'] = "slash", [':'] = "colon",
+    [';'] = "semicolon", ['<'] = "less than", ['='] = "equals", ['>'] = "greater than",
+    ['?'] = "question mark", ['@'] = "at", ['['] = "open bracket", ['\\'] = "backslash",
+    [']'] = "close bracket", ['^'] = "caret", ['_'] = "underscore", ['`'] = "back quote",
+    ['{'] = "open brace", ['|'] = "bar", ['}'] = "close brace", ['~'] = "tilde"
+};
+
+// Currencies by symbol or code: major unit singular/plural, minor unit singular/plural
+static const struct {
+    const char *symbol;
+    const char *major[2];
+    const char *minor[2];
+} g_currencies[] = {
+    {"$", {"dollar", "dollars"}, {"cent", "cents"}},
+    {"USD", {"dollar", "dollars"}, {"cent", "cents"}},
+    {"\xA3", {"pound", "pounds"}, {"penny", "pence"}},
+    {"GBP", {"pound", "pounds"}, {"penny", "pence"}},
+    {"euro", {"euro", "euros"}, {"cent", "cents"}},
+    {"EUR", {"euro", "euros"}, {"cent", "cents"}},
+    {"\xA5", {"yen", "yen"}, {NULL, NULL}},
+    {"JPY", {"yen", "yen"}, {NULL, NULL}}
+};
+
+// Character classes of the say-as scanner
+enum {
+    CHAR_OTHER = 0,
+    CHAR_DIGIT,
+    CHAR_LETTER,
+    CHAR_SPACE
+};
+
+static uint8_t char_class(char c) {
+    unsigned char u = (unsigned char)c;
+    if (u >= '0' && u <= '9') return CHAR_DIGIT;
+    if ((u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= 0xC0 && u != 0xD7 && u != 0xF7)) return CHAR_LETTER;
+    if (u == ' ' || u == '\t' || u == '\n' || u == '\r' || u == 0xA0) return CHAR_SPACE;
+    return CHAR_OTHER;
+}
+
+// A run of the content: digits (thousands separators included), letters, or one other character
+typedef struct {
+    const char *text;
+    size_t length;
+    uint8_t kind;           // CHAR_DIGIT, CHAR_LETTER or CHAR_OTHER
+    uint64_t value;         // Value of a digit run
+    bool overflow;          // Digit run too long for value
+} SayAsToken;
+
+#define SAY_AS_MAX_TOKENS 16
+
+// Split content into tokens, skipping spaces
+// Returns the number of tokens, or -1 if there are too many
+static int say_as_scan(const char *text, size_t length, SayAsToken *tokens) {
+    int count = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        uint8_t kind = char_class(text[i]);
+        if (kind == CHAR_SPACE) {
+            i++;
+            continue;
+        }
+        if (count == SAY_AS_MAX_TOKENS) {
+            return -1;
+        }
+
+        SayAsToken *token = &tokens[count++];
+        token->text = text + i;
+        token->kind = kind;
+        token->value = 0;
+        token->overflow = false;
+
+        if (kind == CHAR_DIGIT) {
+            // A comma followed by three digits continues the number
+            while (i < length) {
+                if (char_class(text[i]) == CHAR_DIGIT) {
+                    uint64_t digit = (uint64_t)(text[i] - '0');
+                    if (token->value > (UINT64_MAX - digit) / 10) {
+                        token->overflow = true;
+                    }
+                    token->value = token->value * 10 + digit;
+                    i++;
+                } else if (text[i] == ',' && i + 3 < length && char_class(text[i + 1]) == CHAR_DIGIT &&
+                           char_class(text[i + 2]) == CHAR_DIGIT && char_class(text[i + 3]) == CHAR_DIGIT &&
+                           (i + 4 == length || char_class(text[i + 4]) != CHAR_DIGIT)) {
+                    i++;
+                } else {
+                    break;
+                }
+            }
+        } else if (kind == CHAR_LETTER) {
+            while (i < length && char_class(text[i]) == CHAR_LETTER) {
+                i++;
+            }
+        } else {
+            i++;
+        }
+        token->length = (size_t)(text + i - token->text);
+    }
+    return count;
+}
+
+static bool token_is(const SayAsToken *token, const char *text) {
+    return token->length == strlen(text) && strncasecmp(token->text, text, token->length) == 0;
+}
+
+// Number of digits of a digit run, not counting separators
+static size_t token_digits(const SayAsToken *token) {
+    size_t digits = 0;
+    for (size_t i = 0; i < token->length; i++) {
+        digits += char_class(token->text[i]) == CHAR_DIGIT;
+    }
+    return digits;
+}
+
+// Normalized words, separated by spaces
+typedef struct {
+    SSMLWriter *writer;
+    bool started;
+} SayAsWords;
+
+static void say_word(SayAsWords *words, const char *word) {
+    if (words->started) {
+        writer_char(words->writer, ' ');
+    }
+    writer_text(words->writer, word, strlen(word));
+    words->started = true;
+}
+
+// Words for n below a thousand; the last word is an ordinal if ordinal is set
+static void say_hundreds(SayAsWords *words, unsigned n, bool ordinal) {
+    unsigned hundreds = n / 100, rest = n % 100;
+
+    if (hundreds) {
+        say_word(words, g_ones[hundreds]);
+        say_word(words, ordinal && rest == 0 ? "hundredth" : "hundred");
+    }
+    if (rest == 0) {
+        return;
+    }
+    if (rest < 20) {
+        say_word(words, ordinal ? g_onesOrdinal[rest] : g_ones[rest]);
+    } else if (rest % 10 == 0) {
+        say_word(words, ordinal ? g_tensOrdinal[rest / 10] : g_tens[rest / 10]);
+    } else {
+        // "twenty-one", written as one word so it is spoken as one
+        say_word(words, g_tens[rest / 10]);
+        writer_char(words->writer, '-');
+        const char *unit = ordinal ? g_onesOrdinal[rest % 10] : g_ones[rest % 10];
+        writer_text(words->writer, unit, strlen(unit));
+    }
+}
+
+// Words for a number, cardinal or ordinal
+static void say_number(SayAsWords *words, uint64_t n, bool ordinal) {
+    if (n == 0) {
+        say_word(words, ordinal ? g_onesOrdinal[0] : g_ones[0]);
+        return;
+    }
+
+    unsigned groups[7] = {0};
+    int count = 0;
+    for (uint64_t rest = n; rest > 0; rest /= 1000) {
+        groups[count++] = (unsigned)(rest % 1000);
+    }
+
+    int last = 0;
+    while (groups[last] == 0) {
+        last++;
+    }
+
+    for (int i = count - 1; i >= last; i--) {
+        if (groups[i] == 0) {
+            continue;
+        }
+        say_hundreds(words, groups[i], ordinal && i == last && i == 0);
+        if (i > 0) {
+            say_word(words, g_scales[i][ordinal && i == last ? 1 : 0]);
+        }
+    }
+}
+
+// Words for a year: "nineteen oh five", "twenty twenty-four", "two thousand five"
+static void say_year(SayAsWords *words, uint64_t year, size_t digits) {
+    uint64_t high = year / 100, low = year % 100;
+
+    if (digits == 2) {
+        // '05 -> oh five
+        if (low < 10) {
+            say_word(words, "oh");
+        }
+        say_number(words, low, false);
+    } else if (year < 1000 || year > 9999 || (year >= 2000 && year < 2010) || year % 1000 == 0) {
+        say_number(words, year, false);
+    } else {
+        say_number(words, high, false);
+        if (low == 0) {
+            say_word(words, "hundred");
+        } else {
+            if (low < 10) {
+                say_word(words, "oh");
+            }
+            say_number(words, low, false);
+        }
+    }
+}
+
+// Spell characters one by one
+static void say_spelled(SayAsWords *words, const char *text, size_t length, bool digitsOnly) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c >= '0' && c <= '9') {
+            say_word(words, g_ones[c - '0']);
+        } else if (digitsOnly) {
+            continue;
+        } else if (isalpha(c)) {
+            say_word(words, g_letterNames[tolower(c) - 'a']);
+        } else if (c < 128 && g_symbolNames[c]) {
+            say_word(words, g_symbolNames[c]);
+        } else if (c >= 0x80) {
+            char letter[2] = { (char)c, '\0' };
+            say_word(words, letter);
+        }
+    }
+}
+
+// Month number for a full or three letter English month name, 0 if unknown
+static int month_from_token(const SayAsToken *token) {
+    for (int month = 0; month < 12; month++) {
+        if ((token->length == 3 || token->length == strlen(g_monthNames[month])) &&
+            strncasecmp(token->text, g_monthNames[month], token->length) == 0) {
+            return month + 1;
+        }
+    }
+    return 0;
+}
+
+// date: numeric fields ordered by format ("mdy", "dmy", "ymd", ...), or guessed
+// from the content, and month names. Spoken as "January fifth, twenty twenty-four".
+static bool say_date(SayAsWords *words, const SayAsToken *tokens, int count, const char *format) {
+    int64_t year = -1, month = -1, day = -1;
+    size_t yearDigits = 4;
+    const SayAsToken *numbers[3];
+    int numberCount = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (tokens[i].kind == CHAR_DIGIT) {
+            if (numberCount == 3 || tokens[i].overflow) {
+                return false;
+            }
+            numbers[numberCount++] = &tokens[i];
+        } else if (tokens[i].kind == CHAR_LETTER) {
+            if (month >= 0 || (month = month_from_token(&tokens[i])) == 0) {
+                return false;
+            }
+        } else if (!strchr("-/.,", tokens[i].text[0])) {
+            return false;
+        }
+    }
+
+    // Field order of the numbers
+    char order[4] = "";
+    if (format && *format) {
+        size_t i = 0;
+        for (const char *f = format; *f && i < 3; f++) {
+            char field = (char)tolower((unsigned char)*f);
+            if ((field == 'm' && month >= 0) || !strchr("ymd", field)) {
+                continue;
+            }
+            order[i++] = field;
+        }
+        order[i] = '\0';
+    } else if (month >= 0) {
+        // Named month: a day and/or a year
+        strcpy(order, numberCount == 2 ? "dy" : (numberCount == 1 && (numbers[0]->value > 31 || token_digits(numbers[0]) == 4) ? "y" : "d"));
+    } else if (numberCount == 3) {
+        strcpy(order, token_digits(numbers[0]) == 4 ? "ymd" : numbers[0]->value > 12 ? "dmy" : "mdy");
+    } else if (numberCount == 2) {
+        strcpy(order, token_digits(numbers[0]) == 4 ? "ym" : token_digits(numbers[1]) == 4 ? "my" : "md");
+    } else if (numberCount == 1) {
+        strcpy(order, "y");
+    }
+    if ((int)strlen(order) != numberCount) {
+        return false;
+    }
+
+    for (int i = 0; i < numberCount; i++) {
+        switch (order[i]) {
+            case 'y':
+                year = (int64_t)numbers[i]->value;
+                yearDigits = token_digits(numbers[i]);
+                break;
+            case 'm': month = (int64_t)numbers[i]->value; break;
+            case 'd': day = (int64_t)numbers[i]->value; break;
+        }
+    }
+    if ((month >= 0 && (month < 1 || month > 12)) || (day >= 0 && (day < 1 || day > 31))) {
+        return false;
+    }
+
+    if (month > 0) {
+        say_word(words, g_monthNames[month - 1]);
+    }
+    if (day > 0) {
+        if (month <= 0) {
+            say_word(words, "the");
+        }
+        say_number(words, (uint64_t)day, true);
+    }
+    if (year >= 0) {
+        if (day > 0) {
+            writer_char(words->writer, ',');
+        }
+        say_year(words, (uint64_t)year, yearDigits);
+    }
+    return true;
+}
+
+// time: "15:07", "3:07 pm", "3 p.m." spoken on a twelve hour clock
+static bool say_time(SayAsWords *words, const SayAsToken *tokens, int count) {
+    uint64_t fields[3];
+    int fieldCount = 0;
+    int meridiem = -1;      // 0 am, 1 pm
+    int i = 0;
+
+    while (i < count && tokens[i].kind == CHAR_DIGIT && fieldCount < 3) {
+        fields[fieldCount++] = tokens[i++].value;
+        if (i < count && tokens[i].kind == CHAR_OTHER && (tokens[i].text[0] == ':' || tokens[i].text[0] == '.') &&
+            i + 1 < count && tokens[i + 1].kind == CHAR_DIGIT) {
+            i++;
+        } else {
+            break;
+        }
+    }
+    if (fieldCount == 0) {
+        return false;
+    }
+
+    // am/pm, possibly written a.m./p.m.
+    if (i < count && tokens[i].kind == CHAR_LETTER) {
+        char marker[3] = "";
+        size_t n = 0;
+        for (; i < count && n < 2; i++) {
+            if (tokens[i].kind == CHAR_LETTER) {
+                for (size_t j = 0; j < tokens[i].length && n < 2; j++) {
+                    marker[n++] = (char)tolower((unsigned char)tokens[i].text[j]);
+                }
+            } else if (tokens[i].text[0] != '.') {
+                return false;
+            }
+        }
+        marker[n] = '\0';
+        while (i < count && tokens[i].kind == CHAR_OTHER && tokens[i].text[0] == '.') {
+            i++;
+        }
+        if (strcmp(marker, "am") == 0) {
+            meridiem = 0;
+        } else if (strcmp(marker, "pm") == 0) {
+            meridiem = 1;
+        } else {
+            return false;
+        }
+    }
+    if (i != count) {
+        return false;
+    }
+
+    uint64_t hour = fields[0], minute = fieldCount > 1 ? fields[1] : 0;
+    if (minute > 59 || (fieldCount > 2 && fields[2] > 59) ||
+        (meridiem < 0 ? hour > 23 : (hour < 1 || hour > 12))) {
+        return false;
+    }
+    if (meridiem < 0) {
+        meridiem = hour >= 12;
+    }
+
+    say_number(words, hour % 12 == 0 ? 12 : hour % 12, false);
+    if (minute > 0) {
+        if (minute < 10) {
+            say_word(words, "oh");
+        }
+        say_number(words, minute, false);
+    }
+    say_word(words, g_letterNames[meridiem ? 'p' - 'a' : 'a' - 'a']);
+    say_word(words, "em");
+    return true;
+}
+
+// currency: "$1,234.50" -> one thousand two hundred thirty-four dollars and fifty cents
+// The symbol or code may come before or after the amount
+static bool say_currency(SayAsWords *words, const SayAsToken *tokens, int count) {
+    int currency = -1;
+    const SayAsToken *major = NULL, *minor = NULL;
+    bool negative = false;
+
+    for (int i = 0; i < count; i++) {
+        const SayAsToken *token = &tokens[i];
+        if (token->kind == CHAR_DIGIT && !major) {
+            major = token;
+            if (i + 2 < count && tokens[i + 1].text[0] == '.' && tokens[i + 2].kind == CHAR_DIGIT) {
+                minor = &tokens[i + 2];
+                i += 2;
+            }
+        } else if (token->kind == CHAR_OTHER && token->text[0] == '-' && !major) {
+            negative = true;
+        } else if (currency < 0) {
+            for (size_t c = 0; c < sizeof(g_currencies) / sizeof(g_currencies[0]); c++) {
+                if (token_is(token, g_currencies[c].symbol)) {
+                    currency = (int)c;
+                    break;
+                }
+            }
+            if (currency < 0) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    if (currency < 0 || !major || major->overflow) {
+        return false;
+    }
+
+    // Cents from the first two decimals, "4.5" is fifty
+    uint64_t cents = 0;
+    if (minor) {
+        size_t digits = token_digits(minor);
+        cents = (uint64_t)(minor->text[0] - '0') * 10 + (digits > 1 ? (uint64_t)(minor->text[1] - '0') : 0);
+    }
+    if (!g_currencies[currency].minor[0]) {
+        cents = 0;
+    }
+
+    if (negative) {
+        say_word(words, "minus");
+    }
+    if (major->value > 0 || cents == 0) {
+        say_number(words, major->value, false);
+        say_word(words, g_currencies[currency].major[major->value == 1 ? 0 : 1]);
+    }
+    if (cents > 0) {
+        if (major->value > 0) {
+            say_word(words, "and");
+        }
+        say_number(words, cents, false);
+        say_word(words, g_currencies[currency].minor[cents == 1 ? 0 : 1]);
+    }
+    return true;
+}
+
+// telephone: digits in the groups of the content, "(555) 123-4567" ->
+// five five five, one two three, four five six seven; a bare ten digit number is grouped 3-3-4
+static bool say_telephone(SayAsWords *words, const SayAsToken *tokens, int count) {
+    bool any = false;
+
+    for (int i = 0; i < count; i++) {
+        const SayAsToken *token = &tokens[i];
+        if (token->kind == CHAR_DIGIT) {
+            size_t digits = token_digits(token);
+            if (any) {
+                writer_char(words->writer, ',');
+            }
+            for (size_t j = 0, n = 0; j < token->length; j++) {
+                if (char_class(token->text[j]) != CHAR_DIGIT) {
+                    continue;
+                }
+                if (digits == 10 && count == 1 && (n == 3 || n == 6)) {
+                    writer_char(words->writer, ',');
+                }
+                say_word(words, g_ones[token->text[j] - '0']);
+                n++;
+            }
+            any = true;
+        } else if (token->kind == CHAR_OTHER && token->text[0] == '+') {
+            say_word(words, "plus");
+        } else if (token->kind == CHAR_LETTER) {
+            // Vanity numbers, 1-800-FLOWERS
+            if (any) {
+                writer_char(words->writer, ',');
+            }
+            say_spelled(words, token->text, token->length, false);
+            any = true;
+        } else if (!strchr("()-./", token->text[0])) {
+            return false;
+        }
+    }
+    return any;
+}
+
+// Denominator words of a fraction: one half, three quarters, five sixteenths
+static void say_denominator(SayAsWords *words, uint64_t denominator, bool plural) {
+    if (denominator == 2) {
+        say_word(words, plural ? "halves" : "half");
+    } else if (denominator == 4) {
+        say_word(words, plural ? "quarters" : "quarter");
+    } else {
+        say_number(words, denominator, true);
+        if (plural) {
+            writer_char(words->writer, 's');
+        }
+    }
+}
+
+// fraction: "3/4", "1 1/2"
+static bool say_fraction(SayAsWords *words, const SayAsToken *tokens, int count) {
+    int i = 0;
+    if (count == 4 && tokens[0].kind == CHAR_DIGIT) {
+        // Whole part
+        i = 1;
+    } else if (count != 3) {
+        return false;
+    }
+    if (tokens[i].kind != CHAR_DIGIT || tokens[i + 1].text[0] != '/' || tokens[i + 2].kind != CHAR_DIGIT ||
+        tokens[i].overflow || tokens[i + 2].overflow || tokens[i + 2].value == 0) {
+        return false;
+    }
+
+    if (i == 1) {
+        say_number(words, tokens[0].value, false);
+        say_word(words, "and");
+    }
+    say_number(words, tokens[i].value, false);
+    say_denominator(words, tokens[i + 2].value, tokens[i].value != 1);
+    return true;
+}
+
+// cardinal, number and ordinal: "-1,234", "3.14", "22nd"
+static bool say_cardinal(SayAsWords *words, const SayAsToken *tokens, int count, bool ordinal) {
+    int i = 0;
+    bool negative = false;
+    if (i < count && tokens[i].kind == CHAR_OTHER && (tokens[i].text[0] == '-' || tokens[i].text[0] == '+')) {
+        negative = tokens[i].text[0] == '-';
+        i++;
+    }
+    if (i >= count || tokens[i].kind != CHAR_DIGIT || tokens[i].overflow) {
+        return false;
+    }
+    const SayAsToken *number = &tokens[i++];
+
+    if (ordinal) {
+        // An ordinal suffix may follow
+        if (i < count && tokens[i].kind == CHAR_LETTER &&
+            (token_is(&tokens[i], "st") || token_is(&tokens[i], "nd") ||
+             token_is(&tokens[i], "rd") || token_is(&tokens[i], "th"))) {
+            i++;
+        }
+    } else if (i + 1 < count && tokens[i].text[0] == '.' && tokens[i + 1].kind == CHAR_DIGIT) {
+        // Decimals are read digit by digit
+        if (negative) {
+            say_word(words, "minus");
+        }
+        say_number(words, number->value, false);
+        say_word(words, "point");
+        say_spelled(words, tokens[i + 1].text, tokens[i + 1].length, true);
+        return i + 2 == count;
+    }
+    if (i != count) {
+        return false;
+    }
+
+    if (negative) {
+        say_word(words, "minus");
+    }
+    say_number(words, number->value, ordinal);
+    return true;
+}
+
+// Speak say-as content according to its interpret-as type and format
+static void say_as_write(SSMLWriter *writer, const char *interpretAs, const char *format,
+                         const char *text, size_t length) {
+    SayAsWords words = { .writer = writer, .started = false };
+
+    // Keep the content apart from the text around it
+    writer_boundary(writer);
+    int32_t start = writer->length;
+    char last = writer->last;
+
+    if (strcasecmp(interpretAs, "characters") == 0 || strcasecmp(interpretAs, "spell-out") == 0) {
+        say_spelled(&words, text, length, false);
+    } else if (strcasecmp(interpretAs, "digits") == 0) {
+        say_spelled(&words, text, length, true);
+    } else {
+        SayAsToken tokens[SAY_AS_MAX_TOKENS];
+        int count = say_as_scan(text, length, tokens);
+        bool spoken = false;
+
+        if (count > 0) {
+            if (strcasecmp(interpretAs, "cardinal") == 0 || strcasecmp(interpretAs, "number") == 0) {
+                spoken = say_cardinal(&words, tokens, count, false);
+            } else if (strcasecmp(interpretAs, "ordinal") == 0) {
+                spoken = say_cardinal(&words, tokens, count, true);
+            } else if (strcasecmp(interpretAs, "date") == 0) {
+                spoken = say_date(&words, tokens, count, format);
+            } else if (strcasecmp(interpretAs, "time") == 0) {
+                spoken = say_time(&words, tokens, count);
+            } else if (strcasecmp(interpretAs, "currency") == 0) {
+                spoken = say_currency(&words, tokens, count);
+            } else if (strcasecmp(interpretAs, "telephone") == 0) {
+                spoken = say_telephone(&words, tokens, count);
+            } else if (strcasecmp(interpretAs, "fraction") == 0) {
+                spoken = say_fraction(&words, tokens, count);
+            }
+        }
+
+        if (!spoken) {
+            // Not what the interpretation expects, drop any partial words
+            writer->length = start;
+            writer->last = last;
+            writer_text(writer, text, length);
+        }
+    }
+
+    writer_char(writer, ' ');
+}
+
+// MARK: - Compiler
+
+// Emphasis as a change of the enclosing prosody
+static const struct {
+    const char *level;
+    int rate;               // Words per minute added
+    double pitch;           // Pitch multiplier
+} g_emphasis[] = {
+    {"none", 0, 1.0},
+    {"reduced", -20, 0.95},     // Slower, lower
+    {"moderate", 0, 1.1},       // Slightly higher pitch
+    {"strong", -30, 1.2}        // Slower, higher pitch
+};
+
+// An open element and the prosody in effect inside it
+typedef struct {
+    SSMLElement element;
+    SSMLProsody prosody;
+} SSMLScope;
+
+typedef struct {
+    SSMLWriter writer;
+    SSMLProsody base;           // Prosody outside of any element
+
+    SSMLScope scopes[SSML_MAX_DEPTH];
+    int depth;
+    int untracked;              // Open elements nested beyond SSML_MAX_DEPTH
+
+    int suppressed;             // Inside <sub alias>, the content isn't spoken
+
+    // Names of the <mark> elements so far, mark N is markNames[N - 1]
+    // Only kept if collectMarks is set, markCount counts them regardless
+    bool collectMarks;
+    bool failed;                // Out of memory
+    char **markNames;
+    int32_t markCount;
+    int32_t markCapacity;
+
+    // Content of the open <say-as>, normalized when it closes
+    bool sayAs;
+    char sayAsType[32];
+    char sayAsFormat[16];
+    char sayAsText[SSML_SAY_AS_MAX];
+    size_t sayAsLength;
+} SSMLCompiler;
+
+static SSMLProsody compiler_prosody(const SSMLCompiler *compiler) {
+    return compiler->depth > 0 ? compiler->scopes[compiler->depth - 1].prosody : compiler->base;
+}
+
+// Switch the engine from one prosody to another with absolute commands
+static void compiler_set_prosody(SSMLCompiler *compiler, SSMLProsody from, SSMLProsody to) {
+    if (to.rate != from.rate) {
+        writer_command(&compiler->writer, "[:rate %d]", to.rate);
+    }
+    if (to.pitch != from.pitch) {
+        writer_command(&compiler->writer, "[:dv ap %d]", to.pitch);
+    }
+    if (to.volume != from.volume) {
+        writer_command(&compiler->writer, "[:volume set %d]", to.volume);
+    }
+}
+
+// Apply the rate, pitch and volume attributes of a <prosody>
+static void prosody_apply(const SSMLCompiler *compiler, const SSMLTag *tag, SSMLProsody *prosody) {
+    char value[SSML_ATTRIBUTE_MAX];
+
+    if (ssml_tag_attribute(tag, "rate", value, sizeof(value))) {
+        prosody->rate = ssml_prosody_rate(value, compiler->base.rate, prosody->rate);
+    }
+    if (ssml_tag_attribute(tag, "pitch", value, sizeof(value))) {
+        prosody->pitch = ssml_prosody_pitch(value, compiler->base.pitch, prosody->pitch);
+    }
+    if (ssml_tag_attribute(tag, "volume", value, sizeof(value))) {
+        prosody->volume = ssml_prosody_volume(value, prosody->volume);
+    }
+}
+
+// Apply the level of an <emphasis>, moderate if it has none
+static void emphasis_apply(const SSMLTag *tag, SSMLProsody *prosody) {
+    char value[SSML_ATTRIBUTE_MAX];
+    size_t level = 2;
+
+    if (ssml_tag_attribute(tag, "level", value, sizeof(value))) {
+        level = 0;
+        for (size_t i = 0; i < sizeof(g_emphasis) / sizeof(g_emphasis[0]); i++) {
+            if (strcasecmp(value, g_emphasis[i].level) == 0) {
+                level = i;
+                break;
+            }
+        }
+    }
+
+    prosody->rate = clamp_value(prosody->rate + g_emphasis[level].rate, SSML_RATE_MIN, SSML_RATE_MAX);
+    prosody->pitch = clamp_value(prosody->pitch * g_emphasis[level].pitch, SSML_PITCH_MIN, SSML_PITCH_MAX);
+}
+
+static void compiler_break(SSMLCompiler *compiler, const SSMLTag *tag) {
+    static const struct { const char *name; int ms; } strengths[] = {
+        {"none", 0}, {"x-weak", 100}, {"weak", 150}, {"medium", 300}, {"strong", 500}, {"x-strong", 1000}
+    };
+    char value[SSML_ATTRIBUTE_MAX];
+    int pauseMs = 250;
+
+    if (ssml_tag_attribute(tag, "time", value, sizeof(value))) {
+        pauseMs = ssml_parse_time(value);
+    } else if (ssml_tag_attribute(tag, "strength", value, sizeof(value))) {
+        for (size_t i = 0; i < sizeof(strengths) / sizeof(strengths[0]); i++) {
+            if (strcasecmp(value, strengths[i].name) == 0) {
+                pauseMs = strengths[i].ms;
+                break;
+            }
+        }
+    }
+
+    if (pauseMs > 0) {
+        writer_char(&compiler->writer, ' ');
+        writer_command(&compiler->writer, "[:pause %d]", pauseMs);
+        writer_char(&compiler->writer, ' ');
+    }
+}
+
+// Turn a <mark> into an index mark command numbered by its position in the document
+static void compiler_mark(SSMLCompiler *compiler, const SSMLTag *tag) {
+    char name[SSML_ATTRIBUTE_MAX];
+    if (!ssml_tag_attribute(tag, "name", name, sizeof(name)) || compiler->markCount == INT32_MAX) {
+        return;
+    }
+
+    if (compiler->collectMarks) {
+        if (compiler->markCount == compiler->markCapacity) {
+            int32_t capacity = compiler->markCapacity ? compiler->markCapacity * 2 : 8;
+            char **names = (char**)realloc(compiler->markNames, (size_t)capacity * sizeof(char*));
+            if (!names) {
+                compiler->failed = true;
+                return;
+            }
+            compiler->markNames = names;
+            compiler->markCapacity = capacity;
+        }
+        compiler->markNames[compiler->markCount] = strdup(name);
+        if (!compiler->markNames[compiler->markCount]) {
+            compiler->failed = true;
+            return;
+        }
+    }
+
+    compiler->markCount++;
+    writer_command(&compiler->writer, "[:index mark %d]", compiler->markCount);
+}
+
+// Speak an attribute value, decoding its entities
+static void compiler_speak_value(SSMLCompiler *compiler, const char *value) {
+    const char *end = value + strlen(value);
+    for (const char *p = value; p < end; ) {
+        uint32_t codePoint;
+        size_t consumed = ssml_decode_entity(p, &codePoint);
+        p += consumed ? consumed : utf8_decode(p, end, &codePoint);
+
+        char single;
+        size_t length;
+        const char *text = engine_text(codePoint, &single, &length);
+        writer_text(&compiler->writer, text, length);
+    }
+}
+
+static void compiler_text(SSMLCompiler *compiler, char c) {
+    if (compiler->suppressed > 0) {
+        return;
+    }
+
+    if (compiler->sayAs) {
+        if (compiler->sayAsLength < sizeof(compiler->sayAsText)) {
+            compiler->sayAsText[compiler->sayAsLength++] = c;
+            return;
+        }
+        // Too long to normalize, speak what was collected as is
+        writer_text(&compiler->writer, compiler->sayAsText, compiler->sayAsLength);
+        compiler->sayAs = false;
+    }
+
+    writer_char(&compiler->writer, c);
+}
+
+// Transcode a character of the content to the engine's character set
+static void compiler_code_point(SSMLCompiler *compiler, uint32_t codePoint) {
+    char single;
+    size_t length;
+    const char *text = engine_text(codePoint, &single, &length);
+    for (size_t i = 0; i < length; i++) {
+        compiler_text(compiler, text[i]);
+    }
+}
+
+static void compiler_open(SSMLCompiler *compiler, const SSMLTag *tag) {
+    // Elements without content
+    if (tag->element == SSMLElementBreak) {
+        compiler_break(compiler, tag);
+        return;
+    }
+    if (tag->element == SSMLElementMark) {
+        compiler_mark(compiler, tag);
+        return;
+    }
+    if (tag->selfClosing) {
+        return;
+    }
+
+    // Too deep to be undone when it closes, only its content is spoken
+    if (compiler->depth == SSML_MAX_DEPTH) {
+        compiler->untracked++;
+        return;
+    }
+
+    char value[SSML_ATTRIBUTE_MAX];
+    SSMLProsody prosody = compiler_prosody(compiler);
+    SSMLScope scope = { .element = tag->element, .prosody = prosody };
+
+    switch (tag->element) {
+        case SSMLElementParagraph:
+        case SSMLElementSentence:
+            writer_boundary(&compiler->writer);
+            break;
+
+        case SSMLElementProsody:
+            prosody_apply(compiler, tag, &scope.prosody);
+            break;
+
+        case SSMLElementEmphasis:
+            emphasis_apply(tag, &scope.prosody);
+            break;
+
+        case SSMLElementSayAs:
+            if (compiler->suppressed == 0 &&
+                ssml_tag_attribute(tag, "interpret-as", compiler->sayAsType, sizeof(compiler->sayAsType))) {
+                if (!ssml_tag_attribute(tag, "format", compiler->sayAsFormat, sizeof(compiler->sayAsFormat))) {
+                    compiler->sayAsFormat[0] = '\0';
+                }
+                compiler->sayAs = true;
+                compiler->sayAsLength = 0;
+            }
+            break;
+
+        case SSMLElementSub:
+            if (compiler->suppressed == 0 && ssml_tag_attribute(tag, "alias", value, sizeof(value))) {
+                compiler_speak_value(compiler, value);
+                compiler->suppressed++;
+            } else {
+                // Without an alias the content is spoken, nothing to undo
+                scope.element = SSMLElementOther;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    compiler_set_prosody(compiler, prosody, scope.prosody);
+    compiler->scopes[compiler->depth++] = scope;
+}
+
+// Undo what opening the innermost element did
+static void compiler_pop(SSMLCompiler *compiler) {
+    SSMLScope *scope = &compiler->scopes[--compiler->depth];
+
+    switch (scope->element) {
+        case SSMLElementParagraph:
+        case SSMLElementSentence:
+            writer_boundary(&compiler->writer);
+            break;
+
+        case SSMLElementSayAs:
+            if (compiler->sayAs) {
+                compiler->sayAs = false;
+                say_as_write(&compiler->writer, compiler->sayAsType, compiler->sayAsFormat,
+                             compiler->sayAsText, compiler->sayAsLength);
+            }
+            break;
+
+        case SSMLElementSub:
+            compiler->suppressed--;
+            break;
+
+        default:
+            break;
+    }
+
+    compiler_set_prosody(compiler, scope->prosody, compiler_prosody(compiler));
+}
+
+static void compiler_close(SSMLCompiler *compiler, const SSMLTag *tag) {
+    if (compiler->untracked > 0) {
+        compiler->untracked--;
+        return;
+    }
+
+    // Find the matching open element; anything still open inside it is closed
+    // too, a closing tag that matches nothing is ignored
+    int match = compiler->depth - 1;
+    while (match >= 0 && compiler->scopes[match].element != tag->element) {
+        match--;
+    }
+    if (match < 0) {
+        return;
+    }
+    while (compiler->depth > match) {
+        compiler_pop(compiler);
+    }
+}
+
+// Handle the markup at '<'
+// Returns the position after it
+static const char *compiler_markup(SSMLCompiler *compiler, const char *text) {
+    // Comments, processing instructions and declarations aren't spoken
+    if (strncmp(text, "<!--", 4) == 0) {
+        const char *end = strstr(text + 4, "-->");
+        return end ? end + 3 : text + strlen(text);
+    }
+    if (text[1] == '?' || text[1] == '!') {
+        const char *end = strchr(text, '>');
+        return end ? end + 1 : text + strlen(text);
+    }
+
+    SSMLTag tag;
+    const char *next = ssml_parse_tag(text, &tag);
+
+    // Markup inside <say-as> is dropped until it closes
+    if (compiler->sayAs && !(tag.closing && tag.element == SSMLElementSayAs)) {
+        return next;
+    }
+
+    if (tag.closing) {
+        compiler_close(compiler, &tag);
+    } else {
+        compiler_open(compiler, &tag);
+    }
+    return next;
+}
+
+void dectalk_ssml_marks_free(char **markNames, int32_t count) {
+    if (!markNames) {
+        return;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        free(markNames[i]);
+    }
+    free(markNames);
+}
+
+int32_t dectalk_ssml_compile(const char *ssml, DECtalkVoice voice, int rate, int volume,
+                             char *out, int32_t outSize) {
+    return dectalk_ssml_compile_marks(ssml, voice, rate, volume, out, outSize, NULL, NULL);
+}
+
+int32_t dectalk_ssml_compile_marks(const char *ssml, DECtalkVoice voice, int rate, int volume,
+                                   char *out, int32_t outSize, char ***markNames, int32_t *markCount) {
+    if (markNames) {
+        *markNames = NULL;
+    }
+    if (markCount) {
+        *markCount = 0;
+    }
+    if (ssml == NULL || outSize < 0 || (out == NULL && outSize > 0) || (markNames != NULL) != (markCount != NULL)) {
+        return -1;
+    }
+    if (voice < 0 || voice >= DECtalkVoiceCount) {
+        voice = DECtalkVoicePaul;
+    }
+
+    SSMLCompiler *compiler = (SSMLCompiler*)calloc(1, sizeof(SSMLCompiler));
+    if (!compiler) {
+        return -1;
+    }
+    compiler->writer.out = out;
+    compiler->writer.size = outSize;
+    compiler->collectMarks = markNames != NULL;
+    compiler->base.rate = rate;
+    compiler->base.pitch = g_voiceBasePitch[voice];
+    compiler->base.volume = volume >= 0 ? volume : 100;
+
+    const char *end = ssml + strlen(ssml);
+    const char *p = ssml;
+    while (p < end) {
+        // Plain text goes straight to the output
+        if (!compiler->sayAs && compiler->suppressed == 0) {
+            size_t run = ascii_run(p, end, true);
+            writer_text(&compiler->writer, p, run);
+            p += run;
+            if (p == end) {
+                break;
+            }
+        }
+
+        if (*p == '<') {
+            p = compiler_markup(compiler, p);
+            continue;
+        }
+
+        uint32_t codePoint;
+        size_t consumed = ssml_decode_entity(p, &codePoint);
+        if (consumed) {
+            p += consumed;
+            compiler_code_point(compiler, codePoint);
+            continue;
+        }
+
+        if ((unsigned char)*p >= 0x80) {
+            p += utf8_decode(p, end, &codePoint);
+            compiler_code_point(compiler, codePoint);
+            continue;
+        }
+
+        // Restore the '[' the system strips from inline commands
+        if (*p == ':' && !compiler->sayAs && compiler->suppressed == 0 &&
+            (compiler->writer.last == 0 || isspace((unsigned char)compiler->writer.last)) &&
+            ssml_is_stripped_command(p + 1)) {
+            writer_put(&compiler->writer, '[');
+        }
+
+        compiler_text(compiler, *p++);
+    }
+
+    // Close whatever the document left open so the next request starts from the base prosody
+    compiler->untracked = 0;
+    while (compiler->depth > 0) {
+        compiler_pop(compiler);
+    }
+    if (compiler->sayAs) {
+        writer_text(&compiler->writer, compiler->sayAsText, compiler->sayAsLength);
+    }
+
+    if (outSize > 0) {
+        out[compiler->writer.length < outSize ? compiler->writer.length : outSize - 1] = '\0';
+    }
+
+    int32_t length = compiler->writer.length;
+    if (compiler->failed) {
+        dectalk_ssml_marks_free(compiler->markNames, compiler->markCount);
+        length = -1;
+    } else if (markNames) {
+        *markNames = compiler->markNames;
+        *markCount = compiler->markCount;
+    }
+    free(compiler);
+    return length;
+}